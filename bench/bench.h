@@ -0,0 +1,36 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+// * Helpers shared by the benchmarks. clock_gettime needs
+// * _POSIX_C_SOURCE defined before the first system header.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static inline double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// * Reads `field` (in KiB) from /proc/self/status, 0 when unavailable
+static inline long proc_status_kib(const char *field) {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f == NULL) return 0;
+
+  char line[256];
+  long value = 0;
+  size_t field_len = strlen(field);
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, field, field_len) == 0 && line[field_len] == ':') {
+      value = strtol(line + field_len + 1, NULL, 10);
+      break;
+    }
+  }
+
+  fclose(f);
+  return value;
+}
+
+#endif // BENCH_H_
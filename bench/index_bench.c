@@ -0,0 +1,88 @@
+// * Benchmark: line indexing throughput per worker thread count
+// *
+// * Usage: index_bench [FILE-PATH] [THREADS...]
+// * Maps FILE-PATH (default: the CSV written by load_bench) and builds the
+// * line rope with loader_index_lines for each thread count (default
+// * 1 2 4 8 16), printing the time, GB/s and speedup over one thread.
+// * The page cache is warmed by a first untimed pass.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../editor.h"
+#include "../rope.h"
+#include "../loader.h"
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define RUNS 3
+
+static void index_once(Editor *editor, size_t threads) {
+  loader_index_lines(editor, threads);
+  rope_free(editor->lines);
+  editor->lines = NULL;
+  editor->size = 0;
+}
+
+int main(int argc, char **argv) {
+  const char *file_path = argc > 1 ? argv[1] : "/tmp/te_load_bench.csv";
+
+  int fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s (run ./load_bench first)\n",
+            file_path, strerror(errno));
+    return 1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    fprintf(stderr, "ERROR: `%s` is empty or unreadable\n", file_path);
+    return 1;
+  }
+
+  Editor editor = {0};
+  editor.original_size = st.st_size;
+  editor.original = mmap(NULL, editor.original_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (editor.original == MAP_FAILED) {
+    fprintf(stderr, "ERROR: could not map `%s`: %s\n", file_path, strerror(errno));
+    return 1;
+  }
+  editor.original_mapped = true;
+  editor.original_fd = -1;
+  close(fd);
+
+  size_t default_threads[] = {1, 2, 4, 8, 16};
+  size_t threads_count = argc > 2 ? (size_t) (argc - 2) : sizeof(default_threads) / sizeof(default_threads[0]);
+
+  printf("%s: %.1f MB, %zu online cpus\n", file_path,
+         editor.original_size / 1e6, loader_default_threads());
+  index_once(&editor, 1);
+
+  double base = 0.0;
+  for (size_t i = 0; i < threads_count; ++i) {
+    size_t threads = argc > 2 ? strtoul(argv[i + 2], NULL, 10) : default_threads[i];
+    if (threads == 0) threads = 1;
+
+    double best = 0.0;
+    for (size_t run = 0; run < RUNS; ++run) {
+      double start = now_secs();
+      index_once(&editor, threads);
+      double elapsed = now_secs() - start;
+      if (run == 0 || elapsed < best) best = elapsed;
+    }
+    if (i == 0) base = best;
+
+    printf("  %2zu threads: %8.2f ms  %6.2f GB/s  x%.2f\n", threads,
+           best * 1e3, editor.original_size / best / 1e9, base / best);
+  }
+
+  munmap(editor.original, editor.original_size);
+  return 0;
+}
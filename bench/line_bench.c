@@ -0,0 +1,121 @@
+// * Microbenchmark: gap buffer `Line` vs the old flat memmove layout
+// *
+// * Types, backspaces and deletes in the middle of lines of growing size
+// * and prints the time per operation for both layouts.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../editor.h"
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+// * The layout `Line` had before the gap buffer: one contiguous run of
+// * text, shifted with memmove on every edit
+typedef struct {
+  size_t capacity;
+  size_t size;
+  char *chars;
+} Flat_Line;
+
+static void flat_line_grow(Flat_Line *line, size_t n) {
+  size_t new_capacity = line->capacity;
+  while (new_capacity - line->size < n) {
+    new_capacity = new_capacity == 0 ? 1024 : new_capacity * 2;
+  }
+  if (new_capacity != line->capacity) {
+    line->chars = realloc(line->chars, new_capacity);
+    line->capacity = new_capacity;
+  }
+}
+
+static void flat_line_insert(Flat_Line *line, const char *text, size_t *col, size_t text_size) {
+  flat_line_grow(line, text_size);
+  memmove(line->chars + *col + text_size, line->chars + *col, line->size - *col);
+  memcpy(line->chars + *col, text, text_size);
+  line->size += text_size;
+  *col += text_size;
+}
+
+static void flat_line_backspace(Flat_Line *line, size_t *col) {
+  if (*col > 0) {
+    memmove(line->chars + *col - 1, line->chars + *col, line->size - *col);
+    line->size -= 1;
+    *col -= 1;
+  }
+}
+
+static void flat_line_delete(Flat_Line *line, size_t *col) {
+  if (*col < line->size) {
+    memmove(line->chars + *col, line->chars + *col + 1, line->size - *col - 1);
+    line->size -= 1;
+  }
+}
+
+static char *filler(size_t size) {
+  char *text = malloc(size);
+  for (size_t i = 0; i < size; ++i) {
+    text[i] = 'a' + i % 26;
+  }
+  return text;
+}
+
+#define OPS 100000
+
+// * Each round: type OPS chars, backspace OPS/2 of them, delete OPS/4
+// * chars to the right of the cursor, all starting in the middle of the line
+static double bench_gap(const char *text, size_t line_size, size_t *final_size) {
+  Line line = {0};
+  line_append_text_sized(&line, text, line_size);
+
+  double start = now_secs();
+  size_t col = line_size / 2;
+  for (size_t i = 0; i < OPS; ++i) line_insert_text_sized_before(&line, "x", &col, 1);
+  for (size_t i = 0; i < OPS / 2; ++i) line_backspace(&line, &col);
+  for (size_t i = 0; i < OPS / 4; ++i) line_delete(&line, &col);
+  double elapsed = now_secs() - start;
+
+  *final_size = line.size;
+  free(line.chars);
+  return elapsed;
+}
+
+static double bench_flat(const char *text, size_t line_size, size_t *final_size) {
+  Flat_Line line = {0};
+  size_t col = 0;
+  flat_line_insert(&line, text, &col, line_size);
+
+  double start = now_secs();
+  col = line_size / 2;
+  for (size_t i = 0; i < OPS; ++i) flat_line_insert(&line, "x", &col, 1);
+  for (size_t i = 0; i < OPS / 2; ++i) flat_line_backspace(&line, &col);
+  for (size_t i = 0; i < OPS / 4; ++i) flat_line_delete(&line, &col);
+  double elapsed = now_secs() - start;
+
+  *final_size = line.size;
+  free(line.chars);
+  return elapsed;
+}
+
+int main(void) {
+  const size_t line_sizes[] = {80, 4 * 1024, 256 * 1024, 4 * 1024 * 1024};
+  const size_t ops = OPS + OPS / 2 + OPS / 4;
+
+  printf("%12s %14s %14s %10s\n", "line bytes", "flat ns/op", "gap ns/op", "speedup");
+  for (size_t i = 0; i < sizeof(line_sizes) / sizeof(line_sizes[0]); ++i) {
+    char *text = filler(line_sizes[i]);
+    size_t flat_size = 0, gap_size = 0;
+    double flat = bench_flat(text, line_sizes[i], &flat_size);
+    double gap = bench_gap(text, line_sizes[i], &gap_size);
+    assert(flat_size == gap_size);
+    printf("%12zu %14.1f %14.1f %9.1fx\n",
+           line_sizes[i], flat * 1e9 / ops, gap * 1e9 / ops, flat / gap);
+    free(text);
+  }
+
+  return 0;
+}
@@ -0,0 +1,142 @@
+// * Benchmark: mmap vs fread loading of a large generated CSV
+// *
+// * Usage: load_bench [LINES] [ROW-BYTES] [FILE-PATH]
+// * Writes LINES rows of about ROW-BYTES bytes to FILE-PATH (reusing it if
+// * it already exists), then loads it with editor_load_from_file (mmap) and
+// * editor_read_from_file (fread). For each prints the time until the first
+// * screen of lines is available, the resident memory split into anonymous
+// * (heap) and file-backed pages, and the editor memory report.
+// *
+// * Both runs see a warm page cache. For cold numbers drop the caches
+// * (echo 3 > /proc/sys/vm/drop_caches) and pass a single mode as the 4th
+// * argument: `mmap`, `read` or `async`. `async` loads in the background
+// * like te does and reports when the first screen and the whole file are
+// * available.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../editor.h"
+#include "../loader.h"
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+static void generate_csv(const char *file_path, size_t lines, size_t row_bytes) {
+  FILE *f = fopen(file_path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    exit(1);
+  }
+
+  char row[256];
+  if (row_bytes >= sizeof(row)) row_bytes = sizeof(row) - 1;
+  for (size_t i = 0; i < lines; ++i) {
+    int n = snprintf(row, sizeof(row), "%zu,%zu,", i, i * 7 % 1000);
+    for (size_t j = n; j < row_bytes; ++j) {
+      row[j] = 'a' + (i + j) % 26;
+    }
+    row[row_bytes] = '\n';
+    fwrite(row, 1, row_bytes + 1, f);
+  }
+
+  fclose(f);
+}
+
+#define FIRST_SCREEN_ROWS 60
+
+static void bench_load(const char *name, const char *file_path,
+                       bool (*load)(Editor *editor, FILE *f)) {
+  FILE *f = fopen(file_path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    exit(1);
+  }
+
+  Editor editor = {0};
+  double start = now_secs();
+  if (!load(&editor, f)) exit(1);
+
+  // * touch what the first frame would draw
+  volatile size_t sink = 0;
+  for (size_t row = 0; row < editor.size && row < FIRST_SCREEN_ROWS; ++row) {
+    String_View text = line_before_gap(editor_line(&editor, row));
+    for (size_t i = 0; i < text.count; ++i) sink += text.data[i];
+  }
+  double elapsed = now_secs() - start;
+  fclose(f);
+
+  printf("== %s ==\n", name);
+  printf("first screen: %.3f s\n", elapsed);
+  printf("RSS anon:     %ld KiB\n", proc_status_kib("RssAnon"));
+  printf("RSS file:     %ld KiB\n", proc_status_kib("RssFile"));
+  editor_memory_report(&editor, stdout);
+
+  editor_free(&editor);
+}
+
+static void bench_async_load(const char *file_path) {
+  FILE *f = fopen(file_path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    exit(1);
+  }
+
+  Editor editor = {0};
+  Loader loader;
+  double start = now_secs();
+  if (!editor_open_file(&editor, f)) exit(1);
+  loader_start(&loader, &editor, loader_default_threads());
+  while (!loader.done && editor.size < FIRST_SCREEN_ROWS) {
+    loader_poll(&loader);
+  }
+  double first_screen = now_secs() - start;
+  size_t first_screen_lines = editor.size;
+  loader_finish(&loader);
+  double full = now_secs() - start;
+  fclose(f);
+
+  printf("== async ==\n");
+  printf("first screen: %.3f s (%zu lines loaded)\n", first_screen, first_screen_lines);
+  printf("full load:    %.3f s\n", full);
+  printf("RSS anon:     %ld KiB\n", proc_status_kib("RssAnon"));
+  printf("RSS file:     %ld KiB\n", proc_status_kib("RssFile"));
+  editor_memory_report(&editor, stdout);
+
+  editor_free(&editor);
+}
+
+int main(int argc, char **argv) {
+  size_t lines = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+  size_t row_bytes = argc > 2 ? strtoull(argv[2], NULL, 10) : 40;
+  const char *file_path = argc > 3 ? argv[3] : "/tmp/te_load_bench.csv";
+
+  FILE *f = fopen(file_path, "r");
+  if (f == NULL) {
+    printf("Generating %zu lines of %zu bytes into %s\n", lines, row_bytes, file_path);
+    generate_csv(file_path, lines, row_bytes);
+    f = fopen(file_path, "r");
+  }
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    return 1;
+  }
+
+  fclose(f);
+
+  const char *mode = argc > 4 ? argv[4] : NULL;
+  if (mode == NULL || strcmp(mode, "mmap") == 0) {
+    bench_load("mmap", file_path, editor_load_from_file);
+  }
+  if (mode == NULL || strcmp(mode, "read") == 0) {
+    bench_load("read", file_path, editor_read_from_file);
+  }
+  if (mode == NULL || strcmp(mode, "async") == 0) {
+    bench_async_load(file_path);
+  }
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+// * Benchmark: frame time of drawing a full screen of text
+// *
+// * Usage: render_bench [WIDTH] [HEIGHT] [SCALE] [FRAMES]
+// * Draws a window-sized grid of glyphs with SDL's software renderer into
+// * an offscreen surface, once with one SDL_RenderCopy per glyph (how te
+// * used to draw, stretching the unscaled atlas), once through the
+// * Glyph_Batch (a single SDL_RenderGeometry call per frame from the atlas
+// * pre-scaled to SCALE), and once straight into the surface on the CPU
+// * (surface.c, the `--software` backend, using the widest SIMD kernel the
+// * machine supports), and prints the average frame time.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <SDL.h>
+
+#include "../render.h"
+#include "../surface.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+typedef struct {
+  size_t rows;
+  size_t cols;
+  char *cells;
+} Fixture;
+
+// * Every cell holds a printable character, lines alternate colors
+static Fixture fixture_dense(int width, int height, int scale) {
+  Fixture fixture = {0};
+  fixture.rows = (size_t) (height / (FONT_CHAR_HEIGHT * scale)) + 1;
+  fixture.cols = (size_t) (width / (FONT_CHAR_WIDTH * scale)) + 1;
+  fixture.cells = malloc(fixture.rows * fixture.cols);
+  for (size_t i = 0; i < fixture.rows * fixture.cols; ++i) {
+    fixture.cells[i] = ASCII_DISPLAY_LOW + 1 + i % (ASCII_DISPLAY_HIGH - ASCII_DISPLAY_LOW);
+  }
+  return fixture;
+}
+
+static Uint32 row_color(size_t row) {
+  return row % 2 == 0 ? 0xFFFFFFFF : 0xFF00FFFF;
+}
+
+// * the unscaled atlas stretched by SDL_RenderCopy, one call per glyph
+static void draw_per_glyph(SDL_Renderer *renderer, const Font_Scale *unscaled, const Fixture *fixture, int scale) {
+  for (size_t row = 0; row < fixture->rows; ++row) {
+    Uint32 color = row_color(row);
+    SDL_SetTextureColorMod(unscaled->atlas, color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF);
+    scc(SDL_SetTextureAlphaMod(unscaled->atlas, (color >> 24) & 0xFF));
+    for (size_t col = 0; col < fixture->cols; ++col) {
+      char c = fixture->cells[row * fixture->cols + col];
+      const SDL_Rect dst = {
+        .x = (int) floorf(col * FONT_CHAR_WIDTH * scale),
+        .y = (int) floorf(row * FONT_CHAR_HEIGHT * scale),
+        .w = (int) floorf(FONT_CHAR_WIDTH * scale),
+        .h = (int) floorf(FONT_CHAR_HEIGHT * scale),
+      };
+      scc(SDL_RenderCopy(renderer, unscaled->atlas, &unscaled->glyph_table[c - ASCII_DISPLAY_LOW], &dst));
+    }
+  }
+}
+
+// * the atlas pre-scaled to `glyphs->scale`, copied 1:1 in one batch
+static void draw_batched(SDL_Renderer *renderer, Glyph_Batch *batch, const Font_Scale *glyphs,
+                         const Fixture *fixture) {
+  for (size_t row = 0; row < fixture->rows; ++row) {
+    render_text_sized(batch, glyphs, &fixture->cells[row * fixture->cols], fixture->cols,
+                      0, (int) row * glyphs->line_height, row_color(row));
+  }
+  glyph_batch_flush(batch, renderer);
+}
+
+// * no renderer: the glyph masks are colored straight into the surface
+static void draw_surface(SDL_Surface *target, const Surface_Font *font, const Fixture *fixture) {
+  const Uint32 colors[2] = {
+    surface_map_color(target, row_color(0)),
+    surface_map_color(target, row_color(1)),
+  };
+  for (size_t row = 0; row < fixture->rows; ++row) {
+    surface_render_text(target, font, &fixture->cells[row * fixture->cols], fixture->cols,
+                        0, (int) row * font->line_height, colors[row % 2]);
+  }
+}
+
+int main(int argc, char **argv) {
+  int width = argc > 1 ? atoi(argv[1]) : 1920;
+  int height = argc > 2 ? atoi(argv[2]) : 1080;
+  int scale = argc > 3 ? atoi(argv[3]) : 2;
+  if (scale < FONT_MIN_SCALE) scale = FONT_MIN_SCALE;
+  if (scale > FONT_MAX_SCALE) scale = FONT_MAX_SCALE;
+  int frames = argc > 4 ? atoi(argv[4]) : 200;
+
+  SDL_Surface *target = scp(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32));
+  SDL_Renderer *renderer = scp(SDL_CreateSoftwareRenderer(target));
+  Font font = font_load(renderer);
+  Fixture fixture = fixture_dense(width, height, scale);
+  Glyph_Batch batch = {0};
+  Surface_Font surface_font = {0};
+  surface_font_set_scale(&surface_font, scale);
+
+  printf("%dx%d at scale %d: %zu glyphs per frame, %d frames\n",
+         width, height, scale, fixture.rows * fixture.cols, frames);
+
+  const char *passes[3] = {"SDL_RenderCopy per glyph", "SDL_RenderGeometry batch", "surface"};
+  for (int pass = 0; pass < 3; ++pass) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int frame = 0; frame < frames; ++frame) {
+      if (pass == 2) {
+        scc(SDL_FillRect(target, NULL, SDL_MapRGBA(target->format, 0, 0, 0, 0)));
+        if (SDL_MUSTLOCK(target)) scc(SDL_LockSurface(target));
+        draw_surface(target, &surface_font, &fixture);
+        if (SDL_MUSTLOCK(target)) SDL_UnlockSurface(target);
+        continue;
+      }
+      scc(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0));
+      scc(SDL_RenderClear(renderer));
+      if (pass == 0) {
+        draw_per_glyph(renderer, font_at_scale(&font, 1), &fixture, scale);
+      } else {
+        draw_batched(renderer, &batch, font_at_scale(&font, scale), &fixture);
+      }
+      SDL_RenderPresent(renderer);
+    }
+    double ms = (double) (SDL_GetPerformanceCounter() - start) * 1000.0
+      / SDL_GetPerformanceFrequency() / frames;
+    if (pass == 2) {
+      printf("  %-24s %8.3f ms/frame (%s)\n", passes[pass], ms, surface_kernel_name());
+    } else {
+      printf("  %-24s %8.3f ms/frame\n", passes[pass], ms);
+    }
+  }
+
+  glyph_batch_free(&batch);
+  surface_font_free(&surface_font);
+  font_drop_atlases(&font);
+  free(fixture.cells);
+  SDL_DestroyRenderer(renderer);
+  SDL_FreeSurface(target);
+  return 0;
+}
@@ -0,0 +1,487 @@
+// * Benchmark: replays edit traces through the editor core, no SDL
+// *
+// * Usage: replay_bench [OPTIONS]
+// * Loads a generated file of --lines lines of --line-bytes bytes, then
+// * replays a trace of typing, Enter, Backspace, Delete and cursor motion
+// * through the same editor_* calls te makes for those keys. For each
+// * trace prints the ops per second, the heap allocations made by the
+// * editor while replaying and the peak resident memory.
+// *
+// * Traces are either synthetic (--scenario, generated from --seed) or
+// * recorded in a text file (--trace), one op per line:
+// *
+// *   type TEXT        insert TEXT before the cursor
+// *   enter            editor_insert_new_line
+// *   backspace        editor_backspace
+// *   delete           editor_delete
+// *   up|down|left|right [N]
+// *   goto ROW COL
+// *
+// * `--dump-trace` prints a synthetic trace in that format, `--json` prints
+// * one JSON object per trace (tagged with --tag, e.g. a commit hash) so
+// * results can be collected per commit.
+// *
+// * Allocations are counted by wrapping malloc and friends at link time
+// * (-Wl,--wrap, see the Makefile), which needs GNU ld or lld.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "../editor.h"
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+// * Allocation counting
+
+typedef struct {
+  bool counting;
+  size_t mallocs;
+  size_t reallocs;
+  size_t frees;
+  size_t bytes;       /* requested by malloc, calloc and realloc */
+} Alloc_Stats;
+
+static Alloc_Stats alloc_stats = {0};
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+  if (alloc_stats.counting) {
+    alloc_stats.mallocs += 1;
+    alloc_stats.bytes += size;
+  }
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  if (alloc_stats.counting) {
+    alloc_stats.mallocs += 1;
+    alloc_stats.bytes += count * size;
+  }
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  if (alloc_stats.counting) {
+    alloc_stats.reallocs += 1;
+    alloc_stats.bytes += size;
+  }
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+  if (alloc_stats.counting && ptr != NULL) {
+    alloc_stats.frees += 1;
+  }
+  __real_free(ptr);
+}
+
+// * Traces
+
+typedef enum {
+  OP_TYPE,
+  OP_ENTER,
+  OP_BACKSPACE,
+  OP_DELETE,
+  OP_UP,
+  OP_DOWN,
+  OP_LEFT,
+  OP_RIGHT,
+  OP_GOTO,
+} Op_Kind;
+
+typedef struct {
+  Op_Kind kind;
+  size_t row;           /* goto                          */
+  size_t col;           /* goto                          */
+  size_t count;         /* repeats of a cursor motion    */
+  char text[16];        /* NUL terminated, for OP_TYPE   */
+} Op;
+
+typedef struct {
+  Op *ops;
+  size_t count;
+  size_t capacity;
+} Trace;
+
+static void trace_push(Trace *trace, Op op) {
+  if (trace->count == trace->capacity) {
+    trace->capacity = trace->capacity == 0 ? 1024 : trace->capacity * 2;
+    trace->ops = realloc(trace->ops, trace->capacity * sizeof(trace->ops[0]));
+  }
+  trace->ops[trace->count++] = op;
+}
+
+static void trace_push_text(Trace *trace, const char *text, size_t size) {
+  // * long text is split so every op stays a fixed size
+  while (size > 0) {
+    Op op = {.kind = OP_TYPE};
+    size_t n = size < sizeof(op.text) - 1 ? size : sizeof(op.text) - 1;
+    memcpy(op.text, text, n);
+    op.text[n] = '\0';
+    trace_push(trace, op);
+    text += n;
+    size -= n;
+  }
+}
+
+static void trace_print(const Trace *trace, FILE *stream) {
+  static const char *motions[] = {
+    [OP_UP] = "up", [OP_DOWN] = "down", [OP_LEFT] = "left", [OP_RIGHT] = "right",
+  };
+  for (size_t i = 0; i < trace->count; ++i) {
+    const Op *op = &trace->ops[i];
+    switch (op->kind) {
+      case OP_TYPE:      fprintf(stream, "type %s\n", op->text); break;
+      case OP_ENTER:     fprintf(stream, "enter\n"); break;
+      case OP_BACKSPACE: fprintf(stream, "backspace\n"); break;
+      case OP_DELETE:    fprintf(stream, "delete\n"); break;
+      case OP_GOTO:      fprintf(stream, "goto %zu %zu\n", op->row, op->col); break;
+      case OP_UP:
+      case OP_DOWN:
+      case OP_LEFT:
+      case OP_RIGHT:     fprintf(stream, "%s %zu\n", motions[op->kind], op->count); break;
+    }
+  }
+}
+
+static bool trace_load(Trace *trace, const char *file_path) {
+  FILE *f = fopen(file_path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    return false;
+  }
+
+  char buffer[4096];
+  size_t line_number = 0;
+  while (fgets(buffer, sizeof(buffer), f)) {
+    line_number += 1;
+    // * only the newline goes, spaces at the end of typed text are kept
+    String_View line = sv_from_cstr(buffer);
+    if (line.count > 0 && line.data[line.count - 1] == '\n') line.count -= 1;
+    if (line.count == 0 || line.data[0] == '#') continue;
+
+    String_View word = sv_chop_by_delim(&line, ' ');
+    Op op = {.count = 1};
+    if (sv_eq(word, SV("type"))) {
+      trace_push_text(trace, line.data, line.count);
+      continue;
+    } else if (sv_eq(word, SV("enter"))) {
+      op.kind = OP_ENTER;
+    } else if (sv_eq(word, SV("backspace"))) {
+      op.kind = OP_BACKSPACE;
+    } else if (sv_eq(word, SV("delete"))) {
+      op.kind = OP_DELETE;
+    } else if (sv_eq(word, SV("goto"))) {
+      op.kind = OP_GOTO;
+      op.row = sv_to_u64(sv_chop_by_delim(&line, ' '));
+      op.col = sv_to_u64(line);
+    } else if (sv_eq(word, SV("up")) || sv_eq(word, SV("down"))
+               || sv_eq(word, SV("left")) || sv_eq(word, SV("right"))) {
+      op.kind = sv_eq(word, SV("up")) ? OP_UP
+        : sv_eq(word, SV("down")) ? OP_DOWN
+        : sv_eq(word, SV("left")) ? OP_LEFT
+        : OP_RIGHT;
+      if (line.count > 0) op.count = sv_to_u64(line);
+    } else {
+      fprintf(stderr, "%s:%zu: ERROR: unknown op `"SV_Fmt"`\n", file_path, line_number, SV_Arg(word));
+      fclose(f);
+      return false;
+    }
+    trace_push(trace, op);
+  }
+
+  fclose(f);
+  return true;
+}
+
+// * xorshift64*, so a seed always gives the same trace
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static size_t rng_below(size_t n) {
+  return n > 0 ? (size_t) (rng_next() % n) : 0;
+}
+
+static Op op_goto_random(size_t lines, size_t line_bytes) {
+  return (Op) {.kind = OP_GOTO, .row = rng_below(lines), .col = rng_below(line_bytes + 1)};
+}
+
+static Op op_type_char(void) {
+  static const char alphabet[] = "etaoin shrdlu cmfwyp vbgkqj xz ,.;()";
+  Op op = {.kind = OP_TYPE};
+  op.text[0] = alphabet[rng_below(sizeof(alphabet) - 1)];
+  return op;
+}
+
+typedef struct {
+  const char *name;
+  const char *description;
+  // * percent of ops of each kind, the rest is cursor motion
+  unsigned type, enter, backspace, delete;
+  size_t burst;   /* ops at one spot before jumping elsewhere */
+} Scenario;
+
+static const Scenario scenarios[] = {
+  {"typing",    "one character per op, Enter now and then",  95,  5,   0,   0, 200},
+  {"enter",     "Enter at random places",                     0, 100,   0,   0,   1},
+  {"backspace", "runs of Backspace at random places",         0,   0, 100,   0,  20},
+  {"delete",    "runs of Delete at random places",            0,   0,   0, 100,  20},
+  {"motion",    "arrows and jumps, no edits",                 0,   0,   0,   0,  50},
+  {"mixed",     "typing, Enter, Backspace, Delete and arrows", 60,  5,  10,   5,  40},
+};
+
+#define SCENARIOS_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static void trace_generate(Trace *trace, const Scenario *scenario, size_t ops, size_t lines, size_t line_bytes) {
+  size_t rows = lines;
+  while (trace->count < ops) {
+    trace_push(trace, op_goto_random(rows, line_bytes));
+    for (size_t i = 0; i < scenario->burst && trace->count < ops; ++i) {
+      unsigned roll = (unsigned) rng_below(100);
+      if (roll < scenario->type) {
+        trace_push(trace, op_type_char());
+      } else if ((roll -= scenario->type) < scenario->enter) {
+        trace_push(trace, (Op) {.kind = OP_ENTER});
+        rows += 1;
+      } else if ((roll -= scenario->enter) < scenario->backspace) {
+        trace_push(trace, (Op) {.kind = OP_BACKSPACE});
+      } else if ((roll -= scenario->backspace) < scenario->delete) {
+        trace_push(trace, (Op) {.kind = OP_DELETE});
+      } else {
+        trace_push(trace, (Op) {.kind = OP_UP + (Op_Kind) rng_below(4), .count = 1 + rng_below(3)});
+      }
+    }
+  }
+}
+
+// * Replay, the way main.c handles the same keys
+
+static void replay(Editor *editor, const Trace *trace) {
+  for (size_t i = 0; i < trace->count; ++i) {
+    const Op *op = &trace->ops[i];
+    switch (op->kind) {
+      case OP_TYPE: {
+        editor_insert_text_before_cursor(editor, op->text);
+      } break;
+
+      case OP_ENTER: {
+        editor_insert_new_line(editor);
+      } break;
+
+      case OP_BACKSPACE: {
+        editor_backspace(editor);
+      } break;
+
+      case OP_DELETE: {
+        editor_delete(editor);
+      } break;
+
+      case OP_UP: {
+        editor->cursor_row = editor->cursor_row > op->count ? editor->cursor_row - op->count : 0;
+      } break;
+
+      case OP_DOWN: {
+        editor->cursor_row += op->count;
+      } break;
+
+      case OP_LEFT: {
+        editor->cursor_col = editor->cursor_col > op->count ? editor->cursor_col - op->count : 0;
+      } break;
+
+      case OP_RIGHT: {
+        editor->cursor_col += op->count;
+      } break;
+
+      case OP_GOTO: {
+        editor->cursor_row = op->row;
+        editor->cursor_col = op->col;
+      } break;
+    }
+  }
+}
+
+// * Resets the peak RSS (VmHWM) to the current RSS, where the kernel allows it
+static void reset_peak_rss(void) {
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if (f == NULL) return;
+  fputs("5", f);
+  fclose(f);
+}
+
+static FILE *file_generate(size_t lines, size_t line_bytes) {
+  FILE *f = tmpfile();
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not create a temporary file: %s\n", strerror(errno));
+    exit(1);
+  }
+
+  char row[256];
+  if (line_bytes >= sizeof(row)) line_bytes = sizeof(row) - 1;
+  for (size_t i = 0; i < lines; ++i) {
+    for (size_t j = 0; j < line_bytes; ++j) {
+      row[j] = 'a' + (i + j) % 26;
+    }
+    row[line_bytes] = '\n';
+    fwrite(row, 1, line_bytes + 1, f);
+  }
+
+  fflush(f);
+  rewind(f);
+  return f;
+}
+
+typedef struct {
+  size_t lines;
+  size_t line_bytes;
+  bool json;
+  const char *tag;
+} Config;
+
+static void bench_trace(const Config *config, const char *name, const Trace *trace) {
+  FILE *f = file_generate(config->lines, config->line_bytes);
+  Editor editor = {0};
+  if (!editor_load_from_file(&editor, f)) exit(1);
+  fclose(f);
+
+  reset_peak_rss();
+  alloc_stats = (Alloc_Stats) {.counting = true};
+  double start = now_secs();
+  replay(&editor, trace);
+  double elapsed = now_secs() - start;
+  alloc_stats.counting = false;
+  const Alloc_Stats allocs = alloc_stats;
+  const long peak_rss = proc_status_kib("VmHWM");
+  const double ops_per_sec = elapsed > 0 ? trace->count / elapsed : 0;
+
+  if (config->json) {
+    printf("{\"bench\":\"replay\",\"tag\":\"%s\",\"trace\":\"%s\",\"lines\":%zu,\"line_bytes\":%zu,"
+           "\"ops\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,\"ns_per_op\":%.1f,"
+           "\"mallocs\":%zu,\"reallocs\":%zu,\"frees\":%zu,\"alloc_bytes\":%zu,"
+           "\"final_lines\":%zu,\"peak_rss_kib\":%ld}\n",
+           config->tag, name, config->lines, config->line_bytes,
+           trace->count, elapsed, ops_per_sec, trace->count > 0 ? elapsed * 1e9 / trace->count : 0.0,
+           allocs.mallocs, allocs.reallocs, allocs.frees, allocs.bytes,
+           editor.size, peak_rss);
+  } else {
+    printf("%-10s %10zu %10.2f %8.1f %10zu %10zu %10.2f %12ld\n",
+           name, trace->count, ops_per_sec / 1e6, trace->count > 0 ? elapsed * 1e9 / trace->count : 0.0,
+           allocs.mallocs + allocs.reallocs, allocs.frees,
+           trace->count > 0 ? (double) (allocs.mallocs + allocs.reallocs) / trace->count : 0.0,
+           peak_rss);
+  }
+
+  editor_free(&editor);
+}
+
+static void usage(FILE *stream) {
+  fprintf(stream, "Usage: replay_bench [OPTIONS]\n");
+  fprintf(stream, "Options:\n");
+  fprintf(stream, "  --lines N          lines in the generated file (default 100000)\n");
+  fprintf(stream, "  --line-bytes N     bytes per line (default 80)\n");
+  fprintf(stream, "  --ops N            ops per synthetic trace (default 1000000)\n");
+  fprintf(stream, "  --seed N           seed of the synthetic traces\n");
+  fprintf(stream, "  --scenario NAME    only this synthetic trace:");
+  for (size_t i = 0; i < SCENARIOS_COUNT; ++i) fprintf(stream, " %s", scenarios[i].name);
+  fprintf(stream, "\n");
+  fprintf(stream, "  --trace FILE       replay a recorded trace instead\n");
+  fprintf(stream, "  --dump-trace       print the synthetic trace of --scenario and exit\n");
+  fprintf(stream, "  --json             one JSON object per trace instead of a table\n");
+  fprintf(stream, "  --tag STR          tag for the JSON output, e.g. the commit hash\n");
+}
+
+int main(int argc, char **argv) {
+  Config config = {.lines = 100000, .line_bytes = 80, .tag = ""};
+  size_t ops = 1000000;
+  const char *scenario_name = NULL;
+  const char *trace_path = NULL;
+  bool dump_trace = false;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--lines") == 0 && has_value) {
+      config.lines = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--line-bytes") == 0 && has_value) {
+      config.line_bytes = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--ops") == 0 && has_value) {
+      ops = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && has_value) {
+      rng_state ^= strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--scenario") == 0 && has_value) {
+      scenario_name = argv[++i];
+    } else if (strcmp(arg, "--trace") == 0 && has_value) {
+      trace_path = argv[++i];
+    } else if (strcmp(arg, "--tag") == 0 && has_value) {
+      config.tag = argv[++i];
+    } else if (strcmp(arg, "--dump-trace") == 0) {
+      dump_trace = true;
+    } else if (strcmp(arg, "--json") == 0) {
+      config.json = true;
+    } else if (strcmp(arg, "--help") == 0) {
+      usage(stdout);
+      return 0;
+    } else {
+      usage(stderr);
+      fprintf(stderr, "ERROR: unknown option or missing value `%s`\n", arg);
+      return 1;
+    }
+  }
+
+  if (!config.json && !dump_trace) {
+    printf("%zu lines of %zu bytes\n", config.lines, config.line_bytes);
+    printf("%-10s %10s %10s %8s %10s %10s %10s %12s\n",
+           "trace", "ops", "Mops/s", "ns/op", "allocs", "frees", "allocs/op", "peak RSS KiB");
+  }
+
+  if (trace_path) {
+    Trace trace = {0};
+    if (!trace_load(&trace, trace_path)) return 1;
+    if (dump_trace) {
+      trace_print(&trace, stdout);
+    } else {
+      bench_trace(&config, trace_path, &trace);
+    }
+    free(trace.ops);
+    return 0;
+  }
+
+  bool found = false;
+  for (size_t i = 0; i < SCENARIOS_COUNT; ++i) {
+    if (scenario_name && strcmp(scenario_name, scenarios[i].name) != 0) continue;
+    found = true;
+
+    Trace trace = {0};
+    trace_generate(&trace, &scenarios[i], ops, config.lines, config.line_bytes);
+    if (dump_trace) {
+      fprintf(stdout, "# %s: %s\n", scenarios[i].name, scenarios[i].description);
+      trace_print(&trace, stdout);
+    } else {
+      bench_trace(&config, scenarios[i].name, &trace);
+    }
+    free(trace.ops);
+  }
+
+  if (!found) {
+    usage(stderr);
+    fprintf(stderr, "ERROR: unknown scenario `%s`\n", scenario_name);
+    return 1;
+  }
+
+  return 0;
+}
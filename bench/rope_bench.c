@@ -0,0 +1,147 @@
+// * Benchmark: rope of lines vs the flat `Line *lines` array
+// *
+// * For documents of 1M, 10M and 50M lines (or the counts given on the
+// * command line) measures random line inserts and the conversions
+// * between rows and byte offsets in both models.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../editor.h"
+#include "../rope.h"
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define FLAT_OPS 20
+#define ROPE_OPS 200000
+#define MAX_LINE 80
+
+static char text[MAX_LINE];
+
+// * Lines borrow from a shared buffer, like an unedited file
+static Line random_line(void) {
+  size_t size = rand() % MAX_LINE;
+  return (Line) { .size = size, .gap = size, .chars = text };
+}
+
+typedef struct {
+  double build;
+  double insert;
+  double offset_of_row;
+  double row_at_offset;
+} Result;
+
+// * The array-of-Line model: memmove to insert, linear scans for offsets
+static Result bench_flat(size_t n, unsigned seed) {
+  Result result = {0};
+  srand(seed);
+
+  double start = now_secs();
+  size_t capacity = n + FLAT_OPS;
+  Line *lines = malloc(capacity * sizeof(Line));
+  size_t total = 0;
+  for (size_t i = 0; i < n; ++i) {
+    lines[i] = random_line();
+    total += lines[i].size + 1;
+  }
+  result.build = now_secs() - start;
+
+  start = now_secs();
+  for (size_t i = 0; i < FLAT_OPS; ++i) {
+    size_t row = rand() % n;
+    memmove(lines + row + 1, lines + row, (n - row) * sizeof(Line));
+    lines[row] = random_line();
+    total += lines[row].size + 1;
+    n += 1;
+  }
+  result.insert = (now_secs() - start) / FLAT_OPS;
+
+  volatile size_t sink = 0;
+  start = now_secs();
+  for (size_t i = 0; i < FLAT_OPS; ++i) {
+    size_t row = rand() % n;
+    size_t offset = 0;
+    for (size_t r = 0; r < row; ++r) offset += lines[r].size + 1;
+    sink += offset;
+  }
+  result.offset_of_row = (now_secs() - start) / FLAT_OPS;
+
+  start = now_secs();
+  for (size_t i = 0; i < FLAT_OPS; ++i) {
+    size_t offset = rand() % total;
+    size_t row = 0;
+    while (offset >= lines[row].size + 1) {
+      offset -= lines[row].size + 1;
+      row += 1;
+    }
+    sink += row;
+  }
+  result.row_at_offset = (now_secs() - start) / FLAT_OPS;
+
+  free(lines);
+  return result;
+}
+
+static Result bench_rope(size_t n, unsigned seed) {
+  Result result = {0};
+  srand(seed);
+
+  double start = now_secs();
+  Rope_Node *root = NULL;
+  for (size_t i = 0; i < n; ++i) {
+    rope_insert(&root, i, random_line());
+  }
+  result.build = now_secs() - start;
+
+  start = now_secs();
+  for (size_t i = 0; i < ROPE_OPS; ++i) {
+    rope_insert(&root, rand() % root->lines, random_line());
+  }
+  result.insert = (now_secs() - start) / ROPE_OPS;
+
+  volatile size_t sink = 0;
+  start = now_secs();
+  for (size_t i = 0; i < ROPE_OPS; ++i) {
+    sink += rope_offset_of_row(root, rand() % root->lines);
+  }
+  result.offset_of_row = (now_secs() - start) / ROPE_OPS;
+
+  size_t total = root->bytes + root->lines;
+  start = now_secs();
+  for (size_t i = 0; i < ROPE_OPS; ++i) {
+    sink += rope_row_at_offset(root, (size_t) rand() * RAND_MAX % total, NULL);
+  }
+  result.row_at_offset = (now_secs() - start) / ROPE_OPS;
+
+  // * lines only borrow `text`, so only the nodes need freeing
+  for (size_t i = 0; i < root->lines; ++i) {
+    rope_line_mut(&root, i)->capacity = 0;
+  }
+  rope_free(root);
+  return result;
+}
+
+static void print_result(const char *model, size_t n, Result r) {
+  printf("%-5s %10zu %10.3f %14.1f %14.1f %14.1f\n", model, n, r.build,
+         r.insert * 1e9, r.offset_of_row * 1e9, r.row_at_offset * 1e9);
+}
+
+int main(int argc, char **argv) {
+  size_t default_sizes[] = {1000000, 10000000, 50000000};
+  size_t sizes_count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+
+  memset(text, 'x', sizeof(text));
+
+  printf("%-5s %10s %10s %14s %14s %14s\n",
+         "model", "lines", "build s", "insert ns", "row->off ns", "off->row ns");
+  for (size_t i = 0; i < (argc > 1 ? (size_t) argc - 1 : sizes_count); ++i) {
+    size_t n = argc > 1 ? strtoull(argv[i + 1], NULL, 10) : default_sizes[i];
+    print_result("flat", n, bench_flat(n, 69));
+    print_result("rope", n, bench_rope(n, 69));
+  }
+
+  return 0;
+}
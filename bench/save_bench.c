@@ -0,0 +1,170 @@
+// * Benchmark: save throughput of a large, lightly edited file
+// *
+// * Usage: save_bench [MB] [EDIT-EVERY] [DIR]
+// * Generates a file of about MB megabytes of 80 byte lines in DIR, loads
+// * it (mmap), edits every EDIT-EVERY-th line and saves it four ways into
+// * DIR, each synced to disk:
+// *   write    the original buffer in a single write(), the disk bandwidth
+// *            the others are measured against
+// *   stdio    one fwrite plus one fputc per line (how te used to save)
+// *   writev   editor_save_to_file with block sharing off: writev batches
+// *            into a temporary file, fsync and rename (save.c)
+// *   atomic   editor_save_to_file: the same, with the unedited runs sharing
+// *            their blocks with the original file where the file system
+// *            can (btrfs, XFS), written elsewhere
+// * and prints the MB/s of each. Then it edits one more line in the middle
+// * and saves, a few times over, and prints the latency of that save with
+// * and without block sharing.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../editor.h"
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define LINE_BYTES 80
+#define ONE_LINE_RUNS 5
+
+static char *path_join(const char *dir, const char *name) {
+  size_t size = strlen(dir) + strlen(name) + 2;
+  char *path = malloc(size);
+  snprintf(path, size, "%s/%s", dir, name);
+  return path;
+}
+
+static void generate(const char *file_path, size_t bytes) {
+  FILE *f = fopen(file_path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    exit(1);
+  }
+
+  char row[LINE_BYTES + 1];
+  for (size_t i = 0; i * sizeof(row) < bytes; ++i) {
+    int n = snprintf(row, sizeof(row), "%zu,", i);
+    for (size_t j = n; j < LINE_BYTES; ++j) {
+      row[j] = 'a' + (i + j) % 26;
+    }
+    row[LINE_BYTES] = '\n';
+    fwrite(row, 1, sizeof(row), f);
+  }
+
+  fclose(f);
+}
+
+static void save_write(const Editor *editor, const char *file_path) {
+  int fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || write(fd, editor->original, editor->original_size) != (ssize_t) editor->original_size
+      || fsync(fd) < 0) {
+    fprintf(stderr, "ERROR: could not write file `%s`: %s\n", file_path, strerror(errno));
+    exit(1);
+  }
+  close(fd);
+}
+
+static void save_stdio(const Editor *editor, const char *file_path) {
+  FILE *f = fopen(file_path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    exit(1);
+  }
+  for (size_t row = 0; row < editor->size; ++row) {
+    const Line *line = editor_line(editor, row);
+    String_View before = line_before_gap(line);
+    String_View after = line_after_gap(line);
+    fwrite(before.data, 1, before.count, f);
+    fwrite(after.data, 1, after.count, f);
+    fputc('\n', f);
+  }
+  fflush(f);
+  fsync(fileno(f));
+  fclose(f);
+}
+
+static void save_writev(const Editor *editor, const char *file_path) {
+  Editor writev_only = *editor;
+  writev_only.original_fd = -1;
+  if (!editor_save_to_file(&writev_only, file_path)) exit(1);
+}
+
+static void save_atomic(const Editor *editor, const char *file_path) {
+  if (!editor_save_to_file(editor, file_path)) exit(1);
+}
+
+static void bench_save(const char *name, const Editor *editor, const char *file_path,
+                       void (*save)(const Editor *editor, const char *file_path)) {
+  double start = now_secs();
+  save(editor, file_path);
+  double elapsed = now_secs() - start;
+  printf("  %-8s %8.3f s %10.1f MB/s\n", name, elapsed, editor->original_size / elapsed / 1e6);
+}
+
+// * Edit one line in the middle of the file, save, and again: the best and the mean save time
+static void bench_one_line(const char *name, Editor *editor, const char *file_path,
+                           void (*save)(const Editor *editor, const char *file_path)) {
+  double best = 0.0, total = 0.0;
+  for (size_t run = 0; run < ONE_LINE_RUNS; ++run) {
+    editor->cursor_row = editor->size / 2 + run;
+    editor->cursor_col = 0;
+    editor_insert_text_before_cursor(editor, "#");
+
+    double start = now_secs();
+    save(editor, file_path);
+    double elapsed = now_secs() - start;
+    if (run == 0 || elapsed < best) best = elapsed;
+    total += elapsed;
+  }
+  printf("  %-8s %8.2f ms best %8.2f ms mean\n", name, best * 1e3, total / ONE_LINE_RUNS * 1e3);
+}
+
+int main(int argc, char **argv) {
+  size_t mb = argc > 1 ? strtoull(argv[1], NULL, 10) : 1024;
+  size_t edit_every = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000;
+  const char *dir = argc > 3 ? argv[3] : "/tmp";
+  if (edit_every == 0) edit_every = 1;
+
+  char *source_path = path_join(dir, "te_save_bench.txt");
+  char *target_path = path_join(dir, "te_save_bench.out");
+  printf("Generating %zu MB into %s\n", mb, source_path);
+  generate(source_path, mb * 1000 * 1000);
+
+  FILE *f = fopen(source_path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", source_path, strerror(errno));
+    return 1;
+  }
+  Editor editor = {0};
+  if (!editor_load_from_file(&editor, f)) return 1;
+  fclose(f);
+
+  // * the edited lines get their own buffers, the rest still point into the mapping
+  for (size_t row = 0; row < editor.size; row += edit_every) {
+    editor.cursor_row = row;
+    editor.cursor_col = 0;
+    editor_insert_text_before_cursor(&editor, "#");
+  }
+  printf("%zu lines, every %zu-th edited\n", editor.size, edit_every);
+
+  bench_save("write", &editor, target_path, save_write);
+  bench_save("stdio", &editor, target_path, save_stdio);
+  bench_save("writev", &editor, target_path, save_writev);
+  bench_save("atomic", &editor, target_path, save_atomic);
+
+  printf("Edit one line, save (%d runs)\n", ONE_LINE_RUNS);
+  bench_one_line("writev", &editor, target_path, save_writev);
+  bench_one_line("atomic", &editor, target_path, save_atomic);
+
+  unlink(target_path);
+  unlink(source_path);
+  editor_free(&editor);
+  free(source_path);
+  free(target_path);
+  return 0;
+}
@@ -0,0 +1,126 @@
+// * Benchmark: newline scanning throughput in GB/s
+// *
+// * Scans a 64 MiB buffer for '\n' with every implementation of the sv.h
+// * byte search (scalar, SSE2, AVX2, AVX-512BW), both one line at a time
+// * (sv_try_chop_by_delim style) and in bulk (sv_index_all style), for
+// * several line length distributions.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define BUFFER_SIZE (64 * 1024 * 1024)
+#define ROUNDS 5
+
+typedef size_t (*Find_Byte)(const char *data, size_t count, char c);
+typedef size_t (*Find_All)(const char *data, size_t count, char c, size_t *indices, size_t capacity);
+
+typedef struct {
+  const char *name;
+  Find_Byte find_byte;
+  Find_All find_all;
+  bool supported;
+} Impl;
+
+// * Fills the buffer with lines of length min_len..max_len
+static size_t fill(char *buffer, size_t min_len, size_t max_len) {
+  size_t lines = 0;
+  size_t i = 0;
+  while (i < BUFFER_SIZE) {
+    size_t len = min_len + (max_len > min_len ? (size_t) rand() % (max_len - min_len + 1) : 0);
+    for (size_t j = 0; j < len && i < BUFFER_SIZE; ++j) {
+      buffer[i++] = 'a' + j % 26;
+    }
+    if (i < BUFFER_SIZE) {
+      buffer[i++] = '\n';
+      lines += 1;
+    }
+  }
+  return lines;
+}
+
+static double bench_chop(const Impl *impl, const char *buffer, size_t expected) {
+  double best = 1e9;
+  for (size_t round = 0; round < ROUNDS; ++round) {
+    double start = now_secs();
+    size_t lines = 0;
+    size_t i = 0;
+    for (;;) {
+      size_t n = impl->find_byte(buffer + i, BUFFER_SIZE - i, '\n');
+      if (i + n == BUFFER_SIZE) break;
+      i += n + 1;
+      lines += 1;
+    }
+    double elapsed = now_secs() - start;
+    if (lines != expected) {
+      fprintf(stderr, "ERROR: %s found %zu lines instead of %zu\n", impl->name, lines, expected);
+      exit(1);
+    }
+    if (elapsed < best) best = elapsed;
+  }
+  return BUFFER_SIZE / best / 1e9;
+}
+
+static double bench_all(const Impl *impl, const char *buffer, size_t expected) {
+  static size_t indices[4096];
+  const size_t capacity = sizeof(indices) / sizeof(indices[0]);
+
+  double best = 1e9;
+  for (size_t round = 0; round < ROUNDS; ++round) {
+    double start = now_secs();
+    size_t lines = 0;
+    size_t i = 0;
+    for (;;) {
+      size_t n = impl->find_all(buffer + i, BUFFER_SIZE - i, '\n', indices, capacity);
+      lines += n;
+      if (n < capacity) break;
+      i += indices[n - 1] + 1;
+    }
+    double elapsed = now_secs() - start;
+    if (lines != expected) {
+      fprintf(stderr, "ERROR: %s found %zu lines instead of %zu\n", impl->name, lines, expected);
+      exit(1);
+    }
+    if (elapsed < best) best = elapsed;
+  }
+  return BUFFER_SIZE / best / 1e9;
+}
+
+int main(void) {
+  const Impl impls[] = {
+    {"scalar", sv__find_byte_scalar, sv__find_all_scalar, true},
+#ifdef SV_SIMD_X86
+    {"sse2", sv__find_byte_sse2, sv__find_all_sse2, true},
+    {"avx2", sv__find_byte_avx2, sv__find_all_avx2, __builtin_cpu_supports("avx2")},
+    {"avx512bw", sv__find_byte_avx512, sv__find_all_avx512, __builtin_cpu_supports("avx512bw")},
+#endif
+  };
+  const struct { const char *name; size_t min_len, max_len; } shapes[] = {
+    {"short 0-16", 0, 16},
+    {"csv 30-50", 30, 50},
+    {"code 0-120", 0, 120},
+    {"long 1-8K", 1024, 8192},
+    {"minified 1M", 1024 * 1024, 1024 * 1024},
+  };
+
+  char *buffer = malloc(BUFFER_SIZE);
+
+  printf("%-12s %-10s %12s %12s\n", "lines", "impl", "chop GB/s", "bulk GB/s");
+  for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+    size_t expected = fill(buffer, shapes[s].min_len, shapes[s].max_len);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+      if (!impls[i].supported) continue;
+      printf("%-12s %-10s %12.2f %12.2f\n", shapes[s].name, impls[i].name,
+             bench_chop(&impls[i], buffer, expected),
+             bench_all(&impls[i], buffer, expected));
+    }
+  }
+
+  free(buffer);
+  return 0;
+}
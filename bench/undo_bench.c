@@ -0,0 +1,147 @@
+// * Benchmark: undo and redo cost against the size of the change
+// *
+// * Pastes 1k, 10k, 100k and 1M lines (or up to the count given on the
+// * command line) into the middle of a 1M-line file, times the paste, its
+// * undo and its redo, and checks that undo gives the file back byte for
+// * byte. Then types a long run of words to show how keystrokes coalesce
+// * and what a keystroke costs in the history.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../editor.h"
+#include "../undo.h"
+#include "bench.h"
+
+#define SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define FILE_LINES 1000000
+#define PASTE_LINE "    pasted_line = paste(line, 42); // from the clipboard"
+#define TYPED_WORDS 200000
+
+// * FNV-1a of every line and its row, to tell two texts apart
+static unsigned long long text_hash(const Editor *editor) {
+  unsigned long long hash = 14695981039346656037ull;
+  for (size_t row = 0; row < editor->size; ++row) {
+    const Line *line = editor_line(editor, row);
+    String_View parts[2] = {line_before_gap(line), line_after_gap(line)};
+    for (size_t i = 0; i < 2; ++i) {
+      for (size_t j = 0; j < parts[i].count; ++j) {
+        hash = (hash ^ (unsigned char) parts[i].data[j]) * 1099511628211ull;
+      }
+    }
+    hash = (hash ^ '\n') * 1099511628211ull;
+  }
+  return hash;
+}
+
+static void open_file(Editor *editor) {
+  FILE *f = tmpfile();
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not create a temporary file\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < FILE_LINES; ++i) {
+    fprintf(f, "line %zu of the file, long enough to look like code\n", i);
+  }
+  rewind(f);
+  if (!editor_load_from_file(editor, f)) exit(1);
+  fclose(f);
+}
+
+// * Pastes `lines` lines at the cursor the way Ctrl+V does
+static void paste(Editor *editor, Undo_History *history, size_t lines) {
+  undo_group_begin(history);
+  for (size_t i = 0; i < lines; ++i) {
+    editor_insert_text_before_cursor(editor, PASTE_LINE);
+    editor_insert_new_line(editor);
+  }
+  undo_group_end(history);
+}
+
+int main(int argc, char **argv) {
+  const size_t max_paste = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+
+  Editor editor = {0};
+  open_file(&editor);
+  Undo_History history;
+  undo_init(&history, (size_t) -1);
+  editor.history = &history;
+  const unsigned long long original = text_hash(&editor);
+
+  printf("Paste into a %d-line file, then undo and redo it:\n", FILE_LINES);
+  printf("  %10s %12s %12s %12s %14s\n", "lines", "paste ms", "undo ms", "redo ms", "history bytes");
+  for (size_t lines = 1000; lines <= max_paste; lines *= 10) {
+    editor.cursor_row = FILE_LINES / 2;
+    editor.cursor_col = 10;
+
+    double start = now_secs();
+    paste(&editor, &history, lines);
+    const double paste_secs = now_secs() - start;
+    const unsigned long long pasted = text_hash(&editor);
+    const size_t bytes = history.bytes;
+
+    start = now_secs();
+    undo_undo(&history, &editor, NULL, NULL);
+    const double undo_secs = now_secs() - start;
+    if (text_hash(&editor) != original) {
+      fprintf(stderr, "ERROR: undoing a paste of %zu lines did not give the file back\n", lines);
+      return 1;
+    }
+
+    start = now_secs();
+    undo_redo(&history, &editor, NULL, NULL);
+    const double redo_secs = now_secs() - start;
+    if (text_hash(&editor) != pasted) {
+      fprintf(stderr, "ERROR: redoing a paste of %zu lines did not paste it again\n", lines);
+      return 1;
+    }
+    undo_undo(&history, &editor, NULL, NULL);
+
+    printf("  %10zu %12.2f %12.2f %12.2f %14zu\n", lines,
+           paste_secs * 1e3, undo_secs * 1e3, redo_secs * 1e3, bytes);
+  }
+
+  // * words of 1 to 8 letters and a space, on lines of 10 words
+  undo_free(&history);
+  undo_init(&history, (size_t) -1);
+  editor.cursor_row = 0;
+  editor.cursor_col = 0;
+  srand(42);
+  size_t keystrokes = 0;
+  const double start = now_secs();
+  for (size_t word = 0; word < TYPED_WORDS; ++word) {
+    const size_t letters = 1 + rand() % 8;
+    for (size_t i = 0; i < letters; ++i) {
+      editor_insert_text_before_cursor(&editor, (char[]) {'a' + rand() % 26, '\0'});
+    }
+    editor_insert_text_before_cursor(&editor, " ");
+    keystrokes += letters + 1;
+    if (word % 10 == 9) {
+      editor_insert_new_line(&editor);
+      keystrokes += 1;
+    }
+  }
+  const double type_secs = now_secs() - start;
+  const size_t groups = history.count;
+
+  size_t undos = 0;
+  const double undo_start = now_secs();
+  while (undo_undo(&history, &editor, NULL, NULL)) undos += 1;
+  const double undo_secs = now_secs() - undo_start;
+  if (text_hash(&editor) != original) {
+    fprintf(stderr, "ERROR: undoing the typing did not give the file back\n");
+    return 1;
+  }
+
+  printf("Typing %d words (%zu keystrokes):\n", TYPED_WORDS, keystrokes);
+  printf("  %.1f ns per keystroke, %zu undo steps, %.1f history bytes per keystroke\n",
+         type_secs * 1e9 / keystrokes, groups, (double) history.bytes / keystrokes);
+  printf("  undoing all of it: %.2f ms (%zu steps)\n", undo_secs * 1e3, undos);
+
+  undo_free(&history);
+  editor_free(&editor);
+  return 0;
+}
@@ -1,19 +1,49 @@
+#define _POSIX_C_SOURCE 200809L
 #include<stdio.h>
 #include<assert.h>
 #include<errno.h>
 #include<string.h>
 #include<stdlib.h>
 #include<stdbool.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
 
 #include "sv.h"
 #include "editor.h"
+#include "rope.h"
+#include "undo.h"
+#include "loader.h"
+#include "save.h"
+#include "tracing.h"
 
-#define LINE_INIT_CAPACITY 1024
-#define EDITOR_INIT_CAPACITY 128
+#define LINE_INIT_CAPACITY 32
+#define ORIGINAL_INIT_CAPACITY (640 * 1024)
 
-static void editor_create_first_new_line(Editor *editor);
+#define LINE_GAP_SIZE(line) ((line)->capacity - (line)->size)
+#define LINE_IS_BORROWED(line) ((line)->capacity == 0 && (line)->chars != NULL)
+
+/*
+* Copies a borrowed line into its own buffer so it can be edited
+* without touching the editor's original buffer
+*/
+static void line_materialize(Line *line) {
+  if (!LINE_IS_BORROWED(line)) return;
+
+  // * leave a little room for typing, the line grows by doubling after that
+  size_t capacity = line->size + LINE_INIT_CAPACITY;
+
+  char *chars = malloc(capacity);
+  memcpy(chars, line->chars, line->size);
+  line->chars = chars;
+  line->capacity = capacity;
+  line->gap = line->size;
+}
 
 static void line_grow(Line *line, size_t n) {
+  line_materialize(line);
+
   size_t new_capacity = line->capacity;
   // printf("new_capacity: %zu, line->size: %zu\n", new_capacity, line->size);
 
@@ -29,11 +59,94 @@ static void line_grow(Line *line, size_t n) {
 
   // * only realloc if not possible to fit in current capacity
   if (new_capacity != line->capacity) {
+    size_t after_gap_size = line->size - line->gap;
     line->chars = realloc(line->chars, new_capacity);
+    // * keep the text after the gap at the end of the new buffer
+    memmove(line->chars + new_capacity - after_gap_size,
+            line->chars + line->capacity - after_gap_size,
+            after_gap_size);
     line->capacity = new_capacity;
   }
 }
 
+/*
+* Moves the gap so it starts at `col`, shifting only the text between
+* the old and the new gap position
+*/
+static void line_move_gap(Line *line, size_t col) {
+  assert(col <= line->size);
+  size_t gap_size = LINE_GAP_SIZE(line);
+
+  if (col < line->gap) {
+    // * text in [col, gap) goes to the right side of the gap
+    memmove(line->chars + col + gap_size,   // * destination address
+            line->chars + col,              // * source address
+            line->gap - col);               // * chunk size
+  } else if (col > line->gap) {
+    // * text in [gap, col) goes to the left side of the gap
+    memmove(line->chars + line->gap,             // * destination address
+            line->chars + line->gap + gap_size,  // * source address
+            col - line->gap);                    // * chunk size
+  }
+
+  line->gap = col;
+}
+
+/*
+* Text on the left side of the gap
+*/
+String_View line_before_gap(const Line *line) {
+  return sv_from_parts(line->chars, line->gap);
+}
+
+/*
+* Text on the right side of the gap
+*/
+String_View line_after_gap(const Line *line) {
+  // * the text after the gap always ends at the end of the buffer
+  size_t after_gap_size = line->size - line->gap;
+  return sv_from_parts(line->chars + line->capacity - after_gap_size,
+                       after_gap_size);
+}
+
+/*
+* Returns the address of the character at `col` (skipping the gap)
+*/
+const char *line_char_at(const Line *line, size_t col) {
+  assert(col < line->size);
+  if (col < line->gap) {
+    return &line->chars[col];
+  }
+  return &line->chars[col + LINE_GAP_SIZE(line)];
+}
+
+/*
+* The parts of both sides of the gap that fall into columns
+* [first_col, first_col + max_cols), e.g. what fits on screen
+*/
+void line_columns(const Line *line, size_t first_col, size_t max_cols,
+                  String_View *before, String_View *after)
+{
+  *before = line_before_gap(line);
+  *after = line_after_gap(line);
+
+  if (first_col < before->count) {
+    before->data += first_col;
+    before->count -= first_col;
+  } else {
+    first_col -= before->count;
+    before->count = 0;
+    if (first_col < after->count) {
+      after->data += first_col;
+      after->count -= first_col;
+    } else {
+      after->count = 0;
+    }
+  }
+  if (before->count > max_cols) before->count = max_cols;
+  if (after->count > max_cols - before->count) after->count = max_cols - before->count;
+}
+
 /*
 * Appends a NULL terminated text at the end of line
 */
@@ -63,15 +176,11 @@ void line_insert_text_sized_before(Line *line,
 
   line_grow(line, text_size);
 
-  // * move chunk from buffer_cursor to buffer_size 
-  size_t move_chunk_size = line->size - *col;
-
-  // * First shift the chunk by `move_chunk_size`
-  memmove(line->chars + *col + text_size,  // * destination address
-          line->chars + *col,              // * source address
-          move_chunk_size);
+  // * bring the gap to the cursor and fill it from the left
+  line_move_gap(line, *col);
+  memcpy(line->chars + line->gap, text, text_size);
 
-  memcpy(line->chars + *col, text, text_size);
+  line->gap += text_size;
   line->size += text_size; // * increase the line current size
   *col += text_size;       // * increase the cursor column index
 }
@@ -93,10 +202,10 @@ void line_backspace(Line *line, size_t *col) {
   }
 
   if (line->size > 0 && *col > 0) {
-    // * shift whole chunk to left by 1
-    memmove(line->chars + *col - 1,   // * destination address
-            line->chars + *col,       // * source address
-            line->size - *col); // * chunk size
+    // * widen the gap by one character on the left
+    line_materialize(line);
+    line_move_gap(line, *col);
+    line->gap -= 1;
 
     line->size -= 1;
     *col -= 1;
@@ -111,90 +220,166 @@ void line_delete(Line *line, size_t *col) {
   }
 
   if (*col < line->size && line->size > 0) {
-    // * shift whole chunk to left by 1
-    memmove(line->chars + *col,     // * destination address
-            line->chars + *col + 1, // * source address
-            line->size - *col);     // * chunk size
+    // * widen the gap by one character on the right
+    line_materialize(line);
+    line_move_gap(line, *col);
 
     line->size -= 1;
   }
 }
 
-static void editor_grow(Editor *editor, size_t n) {
-  size_t new_capacity = editor->capacity;
-  while (new_capacity - editor->size < n) {
-    if(new_capacity == 0) {
-      new_capacity = EDITOR_INIT_CAPACITY;
-    } else {
-      new_capacity *= 2;
-    }
-  }
+/*
+* Takes `size` characters out at `col` by widening the gap over them
+*/
+void line_remove_text(Line *line, size_t col, size_t size) {
+  assert(col + size <= line->size);
+  if (size == 0) return;
+  line_materialize(line);
+  line_move_gap(line, col);
+  line->size -= size;
+}
 
-  if (new_capacity != editor->capacity) {
-    editor->lines = realloc(editor->lines, new_capacity * sizeof(editor->lines[0]));
-    editor->capacity = new_capacity;
-  }
+static Undo_Cursor editor_cursor(const Editor *editor) {
+  return (Undo_Cursor) {editor->cursor_row, editor->cursor_col};
 }
 
 /*
-* insert a new line into lines buffer
+* Hands the change an edit just made to the undo history, `before` being
+* the cursor when the edit started
 */
-void editor_insert_new_line(Editor *editor) {
-  if (editor->cursor_row > editor->size) {
-    editor->cursor_row = editor->size;
-  }
-
-  // * Add one extra line in editor
-  editor_grow(editor, 1);
-
-  // * Move the lines from cursor_row
-  size_t line_size = sizeof(editor->lines[0]);
-  memmove(editor->lines + editor->cursor_row + 1,
-          editor->lines + editor->cursor_row,
-          (editor->size - (editor->cursor_row)) * line_size);
-
-  // * fill the new line with zero
-  editor->cursor_row += 1;
-  editor->cursor_col = 0;
-  memset(&editor->lines[editor->cursor_row], 0, line_size);
-  editor->size += 1;
+static void editor_record(Editor *editor, Undo_Edit edit, Undo_Change change, Undo_Cursor before) {
+  if (editor->history == NULL) return;
+  undo_record(editor->history, edit, &change, before, editor_cursor(editor));
 }
 
-static void editor_create_first_new_line(Editor *editor) {
+static void editor_create_first_new_line(Editor *editor, Undo_Cursor before) {
   if (editor->cursor_row >= editor->size) {
     if (editor->size > 0) { // * go to the last row
       editor->cursor_row = editor->size - 1;
     } else { // * insert new line into editor
-      editor_grow(editor, 1);
-      // * zero initialize the new line 
-      memset(&editor->lines[editor->size], 0, sizeof(editor->lines[0]));
+      rope_insert(&editor->lines, 0, (Line) {0});
       editor->size += 1;
+      editor_record(editor, UNDO_EDIT_ANY, (Undo_Change) {.kind = UNDO_INSERT_LINE, .row = 0}, before);
     }
   } 
 }
 
+/*
+* insert a new line into lines buffer
+*/
+void editor_insert_new_line(Editor *editor) {
+  TRACE_ZONE("editor_insert_new_line");
+  const Undo_Cursor before = editor_cursor(editor);
+  // * Enter on an empty editor or below the last line acts on the last line
+  editor_create_first_new_line(editor, before);
+
+  // * the new empty line goes right after the cursor line
+  editor->cursor_row += 1;
+  editor->cursor_col = 0;
+  rope_insert(&editor->lines, editor->cursor_row, (Line) {0});
+  editor->size += 1;
+  editor_record(editor, UNDO_EDIT_NEWLINE, (Undo_Change) {.kind = UNDO_INSERT_LINE, .row = editor->cursor_row}, before);
+}
+
 /*
 * insert the text in the `lines` using `cursor_row`
 */
 void editor_insert_text_before_cursor(Editor *editor, const char *text) {
-  editor_create_first_new_line(editor);
-  line_insert_text_before(&editor->lines[editor->cursor_row], text, &editor->cursor_col);
+  TRACE_ZONE("editor_insert_text_before_cursor");
+  const Undo_Cursor before = editor_cursor(editor);
+  editor_create_first_new_line(editor, before);
+  Line *line = rope_line_mut(&editor->lines, editor->cursor_row);
+  size_t old_size = line->size;
+  line_insert_text_before(line, text, &editor->cursor_col);
+  rope_line_resized(editor->lines, editor->cursor_row, old_size, line->size);
+
+  const size_t size = line->size - old_size;
+  if (size > 0) {
+    editor_record(editor, UNDO_EDIT_TYPE, (Undo_Change) {
+      .kind = UNDO_INSERT_TEXT, .row = editor->cursor_row,
+      .col = editor->cursor_col - size, .text = text, .size = size,
+    }, before);
+  }
 }
 
 /*
 * Backspace on particular line based on cursor_row & cursor_col
 */
 void editor_backspace(Editor *editor) {
-  editor_create_first_new_line(editor);
-  line_backspace(&editor->lines[editor->cursor_row], &editor->cursor_col);
+  TRACE_ZONE("editor_backspace");
+  const Undo_Cursor before = editor_cursor(editor);
+  editor_create_first_new_line(editor, before);
+  Line *line = rope_line_mut(&editor->lines, editor->cursor_row);
+  size_t old_size = line->size;
+  // * the character going away, for undo
+  const size_t col = editor->cursor_col < line->size ? editor->cursor_col : line->size;
+  const char removed = col > 0 ? *line_char_at(line, col - 1) : 0;
+  line_backspace(line, &editor->cursor_col);
+  rope_line_resized(editor->lines, editor->cursor_row, old_size, line->size);
+
+  if (line->size < old_size) {
+    editor_record(editor, UNDO_EDIT_BACKSPACE, (Undo_Change) {
+      .kind = UNDO_REMOVE_TEXT, .row = editor->cursor_row,
+      .col = editor->cursor_col, .text = &removed, .size = 1,
+    }, before);
+  }
 }
 
 /*
 * Delete on particular line based on cursor_row & cursor_col
 */
 void editor_delete(Editor *editor) {
-  editor_create_first_new_line(editor);
-  line_delete(&editor->lines[editor->cursor_row], &editor->cursor_col);
+  TRACE_ZONE("editor_delete");
+  const Undo_Cursor before = editor_cursor(editor);
+  editor_create_first_new_line(editor, before);
+  Line *line = rope_line_mut(&editor->lines, editor->cursor_row);
+  size_t old_size = line->size;
+  const char removed = editor->cursor_col < line->size ? *line_char_at(line, editor->cursor_col) : 0;
+  line_delete(line, &editor->cursor_col);
+  rope_line_resized(editor->lines, editor->cursor_row, old_size, line->size);
+
+  if (line->size < old_size) {
+    editor_record(editor, UNDO_EDIT_DELETE, (Undo_Change) {
+      .kind = UNDO_REMOVE_TEXT, .row = editor->cursor_row,
+      .col = editor->cursor_col, .text = &removed, .size = 1,
+    }, before);
+  }
+}
+
+/*
+* The changes undo and redo make (and a journal replays) at an exact
+* place: the cursor stays put and nothing is recorded. Places past the
+* end of the text are ignored.
+*/
+void editor_insert_text_at(Editor *editor, size_t row, size_t col, const char *text, size_t size) {
+  if (row >= editor->size) return;
+  Line *line = rope_line_mut(&editor->lines, row);
+  size_t old_size = line->size;
+  line_insert_text_sized_before(line, text, &col, size);
+  rope_line_resized(editor->lines, row, old_size, line->size);
+}
+
+void editor_remove_text_at(Editor *editor, size_t row, size_t col, size_t size) {
+  if (row >= editor->size) return;
+  Line *line = rope_line_mut(&editor->lines, row);
+  if (col > line->size) col = line->size;
+  if (size > line->size - col) size = line->size - col;
+  size_t old_size = line->size;
+  line_remove_text(line, col, size);
+  rope_line_resized(editor->lines, row, old_size, line->size);
+}
+
+void editor_insert_line_at(Editor *editor, size_t row) {
+  if (row > editor->size) return;
+  rope_insert(&editor->lines, row, (Line) {0});
+  editor->size += 1;
+}
+
+void editor_remove_line_at(Editor *editor, size_t row) {
+  if (row >= editor->size) return;
+  Line line = rope_remove(&editor->lines, row);
+  if (!LINE_IS_BORROWED(&line)) free(line.chars);
+  editor->size -= 1;
 }
 
 /*
@@ -202,64 +387,202 @@ void editor_delete(Editor *editor) {
 */
 const char *editor_char_under_cursor(const Editor *editor) {
   if(editor->cursor_row < editor->size) {
-    if (editor->cursor_col < editor->lines[editor->cursor_row].size) {
-      return &editor->lines[editor->cursor_row].chars[editor->cursor_col];
+    const Line *line = editor_line(editor, editor->cursor_row);
+    if (editor->cursor_col < line->size) {
+      return line_char_at(line, editor->cursor_col);
     }
   }
   return NULL;
 }
 
-void editor_save_to_file(const Editor *editor, const char *file_path) {
-  // * open the file
-  FILE *f = fopen(file_path, "w");
-  if(f == NULL) {
-    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
-    exit(1);
+const Line *editor_line(const Editor *editor, size_t row) {
+  return rope_line(editor->lines, row);
+}
+
+/*
+* Byte offset of (row, col) in the saved file, O(log n)
+*/
+size_t editor_offset_at(const Editor *editor, size_t row, size_t col) {
+  if (row >= editor->size) {
+    return rope_offset_of_row(editor->lines, editor->size);
+  }
+
+  const Line *line = editor_line(editor, row);
+  if (col > line->size) {
+    col = line->size;
   }
+  return rope_offset_of_row(editor->lines, row) + col;
+}
 
-  for (size_t row = 0; row < editor->size; ++row) {
-    fwrite(editor->lines[row].chars, 1, editor->lines[row].size, f);
-    fputc('\n', f);
+/*
+* Row and column of a byte offset in the saved file, O(log n)
+*/
+void editor_position_at(const Editor *editor, size_t offset, size_t *row, size_t *col) {
+  size_t row_offset = 0;
+  *row = rope_row_at_offset(editor->lines, offset, &row_offset);
+  *col = 0;
+
+  if (*row < editor->size) {
+    const Line *line = editor_line(editor, *row);
+    *col = offset - row_offset;
+    if (*col > line->size) {
+      *col = line->size;
+    }
   }
+}
 
-  fclose(f);
+/*
+* Saves the text to `file_path` without ever leaving it half written (see
+* save.h). Returns false, with the error printed, when the file could not
+* be saved.
+*/
+bool editor_save_to_file(const Editor *editor, const char *file_path) {
+  TRACE_ZONE("editor_save_to_file");
+  return save_file_atomic(editor, file_path, save_umask(), NULL);
 }
 
-void editor_load_from_file(Editor *editor , FILE *f) {
-  assert(editor->lines == NULL && "You can only load files into an empty editor");
+/*
+* Reads the whole file into the editor's read-only `original` buffer.
+* Seekable files are read straight into a buffer of their exact size;
+* pipes fall back to a doubling buffer that is trimmed at the end.
+* False, with nothing kept, when reading fails.
+*/
+static bool editor_read_original(Editor *editor, FILE *f) {
+  size_t capacity = ORIGINAL_INIT_CAPACITY;
+  if (fseek(f, 0, SEEK_END) == 0) {
+    long size = ftell(f);
+    if (size >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+      // * one extra byte so the first fread already hits the end of file
+      capacity = (size_t) size + 1;
+    }
+  }
+  clearerr(f);
 
-  // * Create a empty new line first
-  editor_create_first_new_line(editor);
-
-  // FILE *f = fopen(file_path, "r");
-  // if (f == NULL) {
-  //   fprintf(stderr, "ERROR: could not open file `%s`:%s\n", file_path, strerror(errno));
-  //   exit(1);
-  // }
-
-  static char chunk[640 * 1024];
-
-  while (!feof(f)) {
-    size_t n = fread(chunk, 1, sizeof(chunk), f);
-    String_View chunk_sv = {
-      .data = chunk,
-      .count = n
-    };
-
-
-    while (chunk_sv.count > 0) {
-      Line *line = &editor->lines[editor->size - 1];
-      String_View chunk_line = {0};
-      if (sv_try_chop_by_delim(&chunk_sv, '\n', &chunk_line)) {
-        line_append_text_sized(line, chunk_line.data, chunk_line.count);
-        editor_insert_new_line(editor);
-      } else {
-        line_append_text_sized(line, chunk_sv.data, chunk_sv.count);
-        chunk_sv = SV_NULL;
-      }
+  editor->original = malloc(capacity);
+  while (!feof(f) && !ferror(f)) {
+    if (editor->original_size == capacity) {
+      capacity *= 2;
+      editor->original = realloc(editor->original, capacity);
     }
+    editor->original_size += fread(editor->original + editor->original_size, 1,
+                                   capacity - editor->original_size, f);
+  }
 
+  // * half a file must not become the document, the next save would write it over the whole one
+  if (ferror(f)) {
+    fprintf(stderr, "ERROR: could not read the file: %s\n", strerror(errno));
+    free(editor->original);
+    editor->original = NULL;
+    editor->original_size = 0;
+    return false;
   }
 
+  if (capacity > editor->original_size + 1) {
+    editor->original = realloc(editor->original, editor->original_size + 1);
+  }
+  return true;
+}
+
+/*
+* Maps a regular file read-only in place of reading it. Pages are only
+* brought in as the line index and the renderer touch them.
+*/
+static bool editor_map_original(Editor *editor, FILE *f) {
+  struct stat st;
+  int fd = fileno(f);
+  if (fd < 0 || fstat(fd, &st) < 0) return false;
+  if (!S_ISREG(st.st_mode) || st.st_size == 0) return false;
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) return false;
+
+  editor->original = data;
+  editor->original_size = st.st_size;
+  editor->original_mapped = true;
+  // * kept open past the caller's fclose: saves share the unedited blocks with it (see save.h)
+  editor->original_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  return true;
+}
+
+/*
+* Loads the file with zero copies: regular files are mmapped and every
+* line points into the mapping until it is edited. Anything that cannot
+* be mapped (pipes, empty files) is read into memory instead.
+*
+* The mapping is private, so the file must not be truncated by someone
+* else while it is open.
+*/
+bool editor_load_from_file(Editor *editor , FILE *f) {
+  TRACE_ZONE("editor_load_from_file");
+  if (!editor_open_file(editor, f)) return false;
+  loader_index_lines(editor, loader_default_threads());
+  return true;
+}
+
+/*
+* Makes the file the editor's original buffer, mapped when possible and
+* read otherwise, without splitting it into lines yet. Used to load the
+* lines in the background (see loader.h).
+*/
+bool editor_open_file(Editor *editor, FILE *f) {
+  TRACE_ZONE("editor_open_file");
+  assert(editor->lines == NULL && "You can only load files into an empty editor");
+
+  if (!editor_map_original(editor, f) && !editor_read_original(editor, f)) {
+    return false;
+  }
   editor->cursor_row = 0;
+  return true;
+}
+
+/*
+* Loads the file by reading all of it into memory owned by the editor
+*/
+bool editor_read_from_file(Editor *editor, FILE *f) {
+  TRACE_ZONE("editor_read_from_file");
+  assert(editor->lines == NULL && "You can only load files into an empty editor");
+
+  // * The file is read once and kept as is, every line just points into it
+  if (!editor_read_original(editor, f)) return false;
+  loader_index_lines(editor, loader_default_threads());
+  editor->cursor_row = 0;
+  return true;
+}
+
+/*
+* Releases every line, the rope and the original buffer
+*/
+void editor_free(Editor *editor) {
+  rope_free(editor->lines);
+  if (editor->original_mapped) {
+    munmap(editor->original, editor->original_size);
+    if (editor->original_fd >= 0) close(editor->original_fd);
+  } else {
+    free(editor->original);
+  }
+  memset(editor, 0, sizeof(*editor));
+}
+
+/*
+* Prints where the editor's memory goes, compared to the size of the file
+*/
+void editor_memory_report(const Editor *editor, FILE *stream) {
+  Rope_Stats stats = rope_stats(editor->lines);
+  // * a mapped file lives in the page cache, not in the editor's heap
+  size_t original_heap = editor->original_mapped ? 0 : editor->original_size;
+  size_t total = original_heap + stats.node_bytes + stats.owned_bytes;
+
+  fprintf(stream, "Memory report:\n");
+  fprintf(stream, "  lines:               %zu\n", editor->size);
+  fprintf(stream, "  original buffer:     %zu bytes%s\n", editor->original_size,
+          editor->original_mapped ? " (mapped from the file)" : "");
+  fprintf(stream, "  rope nodes:          %zu bytes (%zu nodes, %zu bytes per line)\n",
+          stats.node_bytes, stats.nodes, editor->size ? stats.node_bytes / editor->size : 0);
+  fprintf(stream, "  edited line buffers: %zu bytes (%zu lines)\n",
+          stats.owned_bytes, stats.owned_lines);
+  fprintf(stream, "  total heap:          %zu bytes", total);
+  if (editor->original_size > 0) {
+    fprintf(stream, " (%.2fx the file size)", (double) total / editor->original_size);
+  }
+  fprintf(stream, "\n");
 }
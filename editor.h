@@ -1,11 +1,26 @@
 #ifndef EDITOR_H_
 #define EDITOR_H_
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
+#include "sv.h"
+
+/*
+* Line is a gap buffer: the text lives in `chars[0 .. gap)` and
+* `chars[gap + (capacity - size) .. capacity)`. The gap is moved lazily
+* to wherever the next edit happens, so typing at the same spot never
+* shifts the rest of the line.
+*
+* A line with zero capacity and non-NULL chars does not own them:
+* it borrows them from the editor's read-only `original` buffer and is
+* copied into its own gap buffer on the first edit.
+*/
 typedef struct {
   size_t capacity;    /* current line characters capacity */
   size_t size;        /* current line characters count    */
+  size_t gap;         /* gap start (text before the gap)  */
   char *chars;        /* buffer pointer                   */
 } Line;
 
@@ -15,24 +30,48 @@ void line_insert_text_before(Line *line, const char *text, size_t *col);
 void line_insert_text_sized_before(Line *line, const char *text, size_t *col, size_t text_size);
 void line_backspace(Line *line, size_t *col);
 void line_delete(Line *line, size_t *col);
+void line_remove_text(Line *line, size_t col, size_t size);
+String_View line_before_gap(const Line *line);
+String_View line_after_gap(const Line *line);
+const char *line_char_at(const Line *line, size_t col);
+void line_columns(const Line *line, size_t first_col, size_t max_cols,
+                  String_View *before, String_View *after);
+
+typedef struct Rope_Node Rope_Node;
+typedef struct Undo_History Undo_History;
 
 // * High level editor structure
 typedef struct {
-  size_t capacity;       /* current line capacity */
   size_t size;           /* current line count    */
-  Line *lines;           /* line buffer           */
+  Rope_Node *lines;      /* rope of lines (see rope.h) */
   size_t cursor_row;     /* cursor row index      */
   size_t cursor_col;     /* cursor col index      */
+  char *original;        /* file as loaded, never modified (borrowed by unedited lines) */
+  size_t original_size;  /* original buffer size  */
+  bool original_mapped;  /* original is an mmap of the file, not a heap buffer */
+  int original_fd;       /* the mapped file, saves share its blocks (when mapped, -1 if not kept open) */
+  Undo_History *history; /* where edits are recorded for undo, NULL for nowhere */
 } Editor;
 
 void editor_insert_new_line(Editor *editor);
 void editor_insert_text_before_cursor(Editor *editor, const char *text);
 void editor_backspace(Editor *editor);
 void editor_delete(Editor *editor);
+void editor_insert_text_at(Editor *editor, size_t row, size_t col, const char *text, size_t size);
+void editor_remove_text_at(Editor *editor, size_t row, size_t col, size_t size);
+void editor_insert_line_at(Editor *editor, size_t row);
+void editor_remove_line_at(Editor *editor, size_t row);
 const char *editor_char_under_cursor(const Editor *editor);
+const Line *editor_line(const Editor *editor, size_t row);
+size_t editor_offset_at(const Editor *editor, size_t row, size_t col);
+void editor_position_at(const Editor *editor, size_t offset, size_t *row, size_t *col);
 
-void editor_save_to_file(const Editor *editor, const char *file_path);
-void editor_load_from_file(Editor *editor, FILE *f);
+bool editor_save_to_file(const Editor *editor, const char *file_path);
+bool editor_load_from_file(Editor *editor, FILE *f);
+bool editor_read_from_file(Editor *editor, FILE *f);
+bool editor_open_file(Editor *editor, FILE *f);
+void editor_free(Editor *editor);
+void editor_memory_report(const Editor *editor, FILE *stream);
 
 #endif // * EDITOR_H_
 
@@ -0,0 +1,28 @@
+// * Build step: turns the 1 byte per pixel FONT atlas from font.h into the
+// * RGBA32 pixels the font texture is created from, so te needs no image
+// * decoding, no file I/O and no color key pass at startup.
+// *
+// * Usage: fontgen > font_rgba.h
+#include <stdio.h>
+
+#include "font.h"
+
+int main(void) {
+  printf("#ifndef FONT_RGBA_H_\n");
+  printf("#define FONT_RGBA_H_\n\n");
+  printf("// Generated by fontgen from font.h, do not edit\n");
+  printf("// %dx%d SDL_PIXELFORMAT_RGBA32 pixels: white, opaque where the glyphs are\n",
+         FONT_WIDTH, FONT_HEIGHT);
+  printf("static const unsigned char FONT_RGBA[%d * %d * 4] = {\n", FONT_WIDTH, FONT_HEIGHT);
+
+  for (size_t i = 0; i < FONT_WIDTH * FONT_HEIGHT; ++i) {
+    if (i % 4 == 0) printf("   ");
+    // * transparent pixels stay white so filtering never darkens the edges
+    printf(" 0xff, 0xff, 0xff, 0x%02x,", FONT[i] ? 0xff : 0x00);
+    if (i % 4 == 3) printf("\n");
+  }
+
+  printf("};\n\n");
+  printf("#endif // FONT_RGBA_H_\n");
+  return 0;
+}
@@ -0,0 +1,510 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+#include "tracing.h"
+
+static const char JOURNAL_MAGIC[8] = {'T', 'E', 'J', 'R', 'N', 'L', 1, 0};
+
+#define JOURNAL_HEADER_SIZE (sizeof(JOURNAL_MAGIC) + 2 * sizeof(uint64_t))
+#define JOURNAL_RECORD_HEAD_MAX (1 + 3 * 10)   /* op and three varints */
+#define JOURNAL_ORPHAN_MAX 1000                 /* .orphan, then .orphan.1 to .999 */
+
+static uint32_t journal_checksum(const char *data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= (uint8_t) data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static size_t journal_put_varint(char *out, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (char) ((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (char) value;
+  return n;
+}
+
+static bool journal_get_varint(const char *data, size_t size, size_t *at, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *at < size; shift += 7) {
+    const uint8_t c = (uint8_t) data[(*at)++];
+    *value |= (uint64_t) (c & 0x7F) << shift;
+    if ((c & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+// * Little endian, whatever the machine
+static void journal_put_u64(char *out, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) out[i] = (char) (value >> (8 * i));
+}
+
+static uint64_t journal_get_u64(const char *data, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) value |= (uint64_t) (uint8_t) data[i] << (8 * i);
+  return value;
+}
+
+static bool journal_write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool journal_read_all(int fd, char *data, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = pread(fd, data, size, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+static uint64_t journal_realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// * The size and modification time of the file, zero when there is none yet
+Journal_Base journal_base(const char *file_path) {
+  struct stat st;
+  if (stat(file_path, &st) < 0) return (Journal_Base) {0};
+  return (Journal_Base) {
+    .size = (uint64_t) st.st_size,
+    .mtime_ns = (uint64_t) st.st_mtim.tv_sec * 1000000000ull + (uint64_t) st.st_mtim.tv_nsec,
+  };
+}
+
+// * Sets the journal of `file_path` up, true when a previous session left one behind
+bool journal_open(Journal *journal, const char *file_path) {
+  memset(journal, 0, sizeof(*journal));
+  const size_t path_size = strlen(file_path) + sizeof(".journal");
+  journal->path = malloc(path_size);
+  snprintf(journal->path, path_size, "%s.journal", file_path);
+  journal->file_path = strdup(file_path);
+  journal->fd = -1;
+  journal->base = journal_base(file_path);
+  return access(journal->path, F_OK) == 0;
+}
+
+/*
+* Reads the record at `*at`, false when it is cut short or does not match
+* its checksum. `text` points into `data` and is not NUL terminated.
+*/
+static bool journal_parse(const char *data, size_t size, size_t *at, Journal_Op *op,
+                          uint64_t *row, uint64_t *col, const char **text, uint64_t *text_size) {
+  const size_t begin = *at;
+  if (*at >= size) return false;
+  *op = (Journal_Op) (uint8_t) data[(*at)++];
+  if (*op < JOURNAL_INSERT || *op > JOURNAL_REMOVE_LINE_AT) return false;
+  if (!journal_get_varint(data, size, at, row)) return false;
+  if (!journal_get_varint(data, size, at, col)) return false;
+
+  *text = NULL;
+  *text_size = 0;
+  if (*op == JOURNAL_INSERT || *op == JOURNAL_INSERT_AT) {
+    if (!journal_get_varint(data, size, at, text_size)) return false;
+    if (*text_size > size - *at) return false;
+    *text = data + *at;
+    *at += *text_size;
+  } else if (*op == JOURNAL_REMOVE_AT) {
+    if (!journal_get_varint(data, size, at, text_size)) return false;
+  }
+
+  if (size - *at < sizeof(uint32_t)) return false;
+  const uint32_t checksum = (uint32_t) journal_get_u64(data + *at, sizeof(uint32_t));
+  if (checksum != journal_checksum(data + begin, *at - begin)) return false;
+  *at += sizeof(uint32_t);
+  return true;
+}
+
+static void journal_apply(Editor *editor, Journal_Op op, size_t row, size_t col,
+                          const char *text, size_t text_size) {
+  switch (op) {
+    case JOURNAL_INSERT_AT:      editor_insert_text_at(editor, row, col, text, text_size); return;
+    case JOURNAL_REMOVE_AT:      editor_remove_text_at(editor, row, col, text_size); return;
+    case JOURNAL_INSERT_LINE_AT: editor_insert_line_at(editor, row); return;
+    case JOURNAL_REMOVE_LINE_AT: editor_remove_line_at(editor, row); return;
+    default: break;
+  }
+
+  // * the others are keystrokes, replayed from the cursor they had
+  editor->cursor_row = row;
+  editor->cursor_col = col;
+  switch (op) {
+    case JOURNAL_INSERT: {
+      char *inserted = strndup(text, text_size);
+      editor_insert_text_before_cursor(editor, inserted);
+      free(inserted);
+    } break;
+    case JOURNAL_NEWLINE:   editor_insert_new_line(editor); break;
+    case JOURNAL_BACKSPACE: editor_backspace(editor); break;
+    case JOURNAL_DELETE:    editor_delete(editor); break;
+    default: break;
+  }
+}
+
+/*
+* Moves the journal to the first of `<journal>.orphan`, `<journal>.orphan.1`,
+* ... that does not exist. link fails rather than replace an orphan an
+* earlier mismatch left, rename would silently overwrite it.
+*/
+static void journal_set_aside(const Journal *journal) {
+  const size_t orphan_size = strlen(journal->path) + sizeof(".orphan.") + 10;
+  char *orphan = malloc(orphan_size);
+  for (unsigned n = 0; n < JOURNAL_ORPHAN_MAX; ++n) {
+    if (n == 0) snprintf(orphan, orphan_size, "%s.orphan", journal->path);
+    else snprintf(orphan, orphan_size, "%s.orphan.%u", journal->path, n);
+    if (link(journal->path, orphan) == 0) {
+      fprintf(stderr, "WARNING: `%s` does not belong to this version of `%s`, moved it to `%s`\n",
+              journal->path, journal->file_path, orphan);
+      if (unlink(journal->path) < 0) {
+        fprintf(stderr, "ERROR: could not remove `%s`: %s\n", journal->path, strerror(errno));
+      }
+      free(orphan);
+      return;
+    }
+    if (errno != EEXIST) break;
+  }
+  fprintf(stderr, "ERROR: could not move `%s` aside to `%s`: %s\n", journal->path, orphan,
+          errno == EEXIST ? "too many orphans, remove some" : strerror(errno));
+  free(orphan);
+}
+
+/*
+* Replays the journal a previous session left behind on top of the
+* freshly loaded file, returns how many edits came back. A journal made
+* for another version of the file is moved aside to `<file>.journal.orphan`
+* (or `.orphan.N`, the next free one) untouched, and a torn last record (te died mid-write) is cut off. The
+* recovered edits stay in the journal until the next save.
+*/
+size_t journal_recover(Journal *journal, Editor *editor) {
+  TRACE_ZONE("journal_recover");
+  int fd = open(journal->path, O_RDWR | O_APPEND | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", journal->path, strerror(errno));
+    if (fd >= 0) close(fd);
+    return 0;
+  }
+
+  const size_t size = (size_t) st.st_size;
+  char *data = malloc(size > 0 ? size : 1);
+  if (!journal_read_all(fd, data, size, 0)) {
+    fprintf(stderr, "ERROR: could not read file `%s`: %s\n", journal->path, strerror(errno));
+    free(data);
+    close(fd);
+    return 0;
+  }
+
+  if (size < JOURNAL_HEADER_SIZE
+      || memcmp(data, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+      || journal_get_u64(data + sizeof(JOURNAL_MAGIC), sizeof(uint64_t)) != journal->base.size
+      || journal_get_u64(data + sizeof(JOURNAL_MAGIC) + sizeof(uint64_t), sizeof(uint64_t)) != journal->base.mtime_ns) {
+    // * replaying it on another text would scramble it, but it may still hold someone's work
+    journal_set_aside(journal);
+    free(data);
+    close(fd);
+    return 0;
+  }
+
+  size_t edits = 0;
+  size_t at = JOURNAL_HEADER_SIZE;
+  size_t valid = at;
+  Journal_Op op;
+  uint64_t row, col, text_size;
+  const char *text;
+  while (journal_parse(data, size, &at, &op, &row, &col, &text, &text_size)) {
+    journal_apply(editor, op, row, col, text, text_size);
+    valid = at;
+    edits += 1;
+  }
+  free(data);
+
+  if (valid < size) {
+    fprintf(stderr, "WARNING: dropping the last %zu bytes of `%s`, they were cut short\n",
+            size - valid, journal->path);
+    if (ftruncate(fd, valid) < 0) {
+      fprintf(stderr, "ERROR: could not truncate `%s`: %s\n", journal->path, strerror(errno));
+    }
+  }
+
+  // * new edits go after the recovered ones
+  journal->fd = fd;
+  journal->appended = valid - JOURNAL_HEADER_SIZE;
+  journal->file_start = 0;
+  journal->file_end = journal->appended;
+  return edits;
+}
+
+// * A new, empty journal at `path` for the file as it is in `journal->base`
+static int journal_create(const Journal *journal, const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+  if (fd < 0) return -1;
+
+  char header[JOURNAL_HEADER_SIZE];
+  memcpy(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+  journal_put_u64(header + sizeof(JOURNAL_MAGIC), journal->base.size, sizeof(uint64_t));
+  journal_put_u64(header + sizeof(JOURNAL_MAGIC) + sizeof(uint64_t), journal->base.mtime_ns, sizeof(uint64_t));
+  if (!journal_write_all(fd, header, sizeof(header))) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// * Gives the journal up for the rest of the session: editing goes on unprotected
+static void journal_fail(Journal *journal, const char *action) {
+  fprintf(stderr, "ERROR: could not %s `%s`: %s; unsaved edits are not journaled anymore\n",
+          action, journal->path, strerror(errno));
+  journal->failed = true;
+}
+
+// * Appends a batch of records, creating the journal with the first one
+static void journal_write(Journal *journal, const char *data, size_t size) {
+  TRACE_ZONE("journal_write");
+  if (journal->failed) return;
+  if (journal->fd < 0) {
+    journal->fd = journal_create(journal, journal->path);
+    if (journal->fd < 0) {
+      journal_fail(journal, "create");
+      return;
+    }
+    journal->file_start = journal->file_end;
+  }
+  if (!journal_write_all(journal->fd, data, size)) {
+    journal_fail(journal, "write");
+    return;
+  }
+  journal->file_end += size;
+  journal->dirty = true;
+}
+
+static void journal_sync(Journal *journal) {
+  TRACE_ZONE("journal_sync");
+  if (!journal->failed && journal->fd >= 0 && fsync(journal->fd) < 0) {
+    journal_fail(journal, "sync");
+  }
+  journal->dirty = false;
+}
+
+/*
+* After a save of everything appended before `cut`: the journal starts
+* over from the saved file `base`, with only the records past `cut` (the
+* edits made while the save ran), or goes away when there are none.
+*/
+static void journal_compact_file(Journal *journal, uint64_t cut, Journal_Base base) {
+  TRACE_ZONE("journal_compact");
+  journal->base = base;
+  if (journal->failed || journal->fd < 0 || cut < journal->file_start) return;
+
+  if (cut >= journal->file_end) {
+    close(journal->fd);
+    journal->fd = -1;
+    if (unlink(journal->path) < 0) journal_fail(journal, "remove");
+    journal->file_start = journal->file_end;
+    journal->dirty = false;
+    return;
+  }
+
+  // * the new journal is written aside and renamed over, a crash leaves one or the other
+  const size_t tail_size = journal->file_end - cut;
+  char *tail = malloc(tail_size);
+  const size_t temp_size = strlen(journal->path) + sizeof(".tmp");
+  char *temp_path = malloc(temp_size);
+  snprintf(temp_path, temp_size, "%s.tmp", journal->path);
+
+  int fd = -1;
+  if (!journal_read_all(journal->fd, tail, tail_size, JOURNAL_HEADER_SIZE + (cut - journal->file_start))) {
+    journal_fail(journal, "read");
+  } else if ((fd = journal_create(journal, temp_path)) < 0
+             || !journal_write_all(fd, tail, tail_size)
+             || fsync(fd) < 0
+             || rename(temp_path, journal->path) < 0) {
+    journal_fail(journal, "compact");
+    if (fd >= 0) close(fd);
+    unlink(temp_path);
+  } else {
+    close(journal->fd);
+    journal->fd = fd;
+    journal->file_start = cut;
+    journal->dirty = false;
+  }
+  free(temp_path);
+  free(tail);
+}
+
+static void *journal_thread(void *arg) {
+  Journal *journal = arg;
+  tracing_thread_name("journal");
+  char *batch = NULL;
+  size_t batch_capacity = 0;
+  uint64_t synced_ns = 0;
+
+  pthread_mutex_lock(&journal->lock);
+  for (;;) {
+    // * sleep until there is something to write, or until what was written is due for fsync
+    while (journal->pending_size == 0 && !journal->compact && !journal->quit) {
+      if (!journal->dirty) {
+        pthread_cond_wait(&journal->wake, &journal->lock);
+        continue;
+      }
+      const uint64_t due_ns = synced_ns + JOURNAL_SYNC_MS * 1000000ull;
+      const struct timespec due = {(time_t) (due_ns / 1000000000ull), (long) (due_ns % 1000000000ull)};
+      if (pthread_cond_timedwait(&journal->wake, &journal->lock, &due) == ETIMEDOUT) break;
+    }
+
+    // * everything appended so far goes out in one write, the input thread fills the other buffer
+    char *taken = journal->pending;
+    const size_t taken_size = journal->pending_size;
+    const size_t taken_capacity = journal->pending_capacity;
+    journal->pending = batch;
+    journal->pending_capacity = batch_capacity;
+    journal->pending_size = 0;
+    batch = taken;
+    batch_capacity = taken_capacity;
+
+    const bool compact = journal->compact;
+    const uint64_t cut = journal->compact_cut;
+    const Journal_Base base = journal->compact_base;
+    journal->compact = false;
+    const bool quit = journal->quit;
+    pthread_mutex_unlock(&journal->lock);
+
+    if (taken_size > 0) journal_write(journal, batch, taken_size);
+    if (compact) journal_compact_file(journal, cut, base);
+    const uint64_t now_ns = journal_realtime_ns();
+    if (journal->dirty && (quit || now_ns - synced_ns >= JOURNAL_SYNC_MS * 1000000ull)) {
+      journal_sync(journal);
+      synced_ns = now_ns;
+    }
+
+    pthread_mutex_lock(&journal->lock);
+    if (quit && journal->pending_size == 0) break;
+  }
+  pthread_mutex_unlock(&journal->lock);
+  free(batch);
+  return NULL;
+}
+
+bool journal_start(Journal *journal) {
+  pthread_mutex_init(&journal->lock, NULL);
+  pthread_cond_init(&journal->wake, NULL);
+  if (pthread_create(&journal->thread, NULL, journal_thread, journal) != 0) {
+    fprintf(stderr, "ERROR: could not start the journal thread, unsaved edits are not journaled\n");
+    pthread_cond_destroy(&journal->wake);
+    pthread_mutex_destroy(&journal->lock);
+    return false;
+  }
+  journal->started = true;
+  return true;
+}
+
+/*
+* Journals the edit `op` about to be applied at the editor's cursor,
+* `text` being what JOURNAL_INSERT inserts. Never touches the disk.
+*/
+void journal_append(Journal *journal, const Editor *editor, Journal_Op op, const char *text) {
+  journal_append_at(journal, op, editor->cursor_row, editor->cursor_col,
+                    text, op == JOURNAL_INSERT ? strlen(text) : 0);
+}
+
+/*
+* Journals `op` at `row`, `col`, with `size` bytes of `text` to insert
+* or, for JOURNAL_REMOVE_AT, `size` bytes to take out
+*/
+void journal_append_at(Journal *journal, Journal_Op op, size_t row, size_t col,
+                       const char *text, size_t size) {
+  if (!journal->started) return;
+  const bool has_text = op == JOURNAL_INSERT || op == JOURNAL_INSERT_AT;
+  const size_t text_size = has_text ? size : 0;
+
+  pthread_mutex_lock(&journal->lock);
+  const size_t needed = journal->pending_size + JOURNAL_RECORD_HEAD_MAX + text_size + sizeof(uint32_t);
+  if (needed > journal->pending_capacity) {
+    journal->pending_capacity = needed > 2 * journal->pending_capacity ? needed : 2 * journal->pending_capacity;
+    journal->pending = realloc(journal->pending, journal->pending_capacity);
+  }
+
+  char *record = journal->pending + journal->pending_size;
+  size_t n = 0;
+  record[n++] = (char) op;
+  n += journal_put_varint(record + n, row);
+  n += journal_put_varint(record + n, col);
+  if (has_text || op == JOURNAL_REMOVE_AT) {
+    n += journal_put_varint(record + n, size);
+  }
+  if (has_text) {
+    memcpy(record + n, text, text_size);
+    n += text_size;
+  }
+  journal_put_u64(record + n, journal_checksum(record, n), sizeof(uint32_t));
+  n += sizeof(uint32_t);
+
+  journal->pending_size += n;
+  journal->appended += n;
+  pthread_cond_signal(&journal->wake);
+  pthread_mutex_unlock(&journal->lock);
+}
+
+// * Where the journal is now, to hand to journal_compact once a save of the editor as it is now is done
+uint64_t journal_mark(const Journal *journal) {
+  return journal->appended;
+}
+
+// * The file was saved with every edit journaled before `cut`
+void journal_compact(Journal *journal, uint64_t cut) {
+  if (!journal->started) return;
+  const Journal_Base base = journal_base(journal->file_path);
+  pthread_mutex_lock(&journal->lock);
+  journal->compact = true;
+  journal->compact_cut = cut;
+  journal->compact_base = base;
+  pthread_cond_signal(&journal->wake);
+  pthread_mutex_unlock(&journal->lock);
+}
+
+// * Writes out and syncs the edits still buffered and stops the writer thread
+void journal_close(Journal *journal) {
+  if (journal->started) {
+    pthread_mutex_lock(&journal->lock);
+    journal->quit = true;
+    pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->thread, NULL);
+    pthread_cond_destroy(&journal->wake);
+    pthread_mutex_destroy(&journal->lock);
+    journal->started = false;
+  }
+  if (journal->fd >= 0) close(journal->fd);
+  journal->fd = -1;
+  free(journal->pending);
+  free(journal->path);
+  free(journal->file_path);
+  journal->pending = NULL;
+  journal->path = NULL;
+  journal->file_path = NULL;
+}
@@ -0,0 +1,90 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "editor.h"
+
+#define JOURNAL_SYNC_MS 500   /* longest a written edit waits for fsync */
+
+/*
+* Write-ahead journal of the edits made since the file was last saved,
+* kept next to it as `<file>.journal`, so a crash loses none of them.
+* Every edit is appended before it is applied and replayed on top of the
+* file when te opens it again.
+*
+*   "TEJRNL\1\0"                  magic and version
+*   u64 size, u64 mtime_ns        the file the edits apply to (Journal_Base)
+*   records until the end of the journal:
+*     u8 op                       Journal_Op
+*     varint row, varint col      the cursor before the edit, or where the
+*                                 change goes for the JOURNAL_*_AT ops
+*     varint length, bytes        JOURNAL_INSERT and JOURNAL_INSERT_AT: the text
+*     varint length               JOURNAL_REMOVE_AT: the bytes taken out
+*     u32 checksum                FNV-1a of the record, so a torn tail is dropped
+*
+* Appending only copies the record into a buffer. A writer thread sends
+* whatever piled up meanwhile in one write (group commit) and fsyncs at
+* most every JOURNAL_SYNC_MS, so typing never waits for the disk. After a
+* save the journal is compacted down to the edits the save did not
+* cover, and removed when there are none.
+*/
+typedef enum {
+  JOURNAL_INSERT = 1,
+  JOURNAL_NEWLINE,
+  JOURNAL_BACKSPACE,
+  JOURNAL_DELETE,
+  // * what undo and redo change, at an exact place (see undo.h)
+  JOURNAL_INSERT_AT,
+  JOURNAL_REMOVE_AT,
+  JOURNAL_INSERT_LINE_AT,
+  JOURNAL_REMOVE_LINE_AT,
+} Journal_Op;
+
+// * Which version of the file a journal belongs to
+typedef struct {
+  uint64_t size;
+  uint64_t mtime_ns;
+} Journal_Base;
+
+typedef struct {
+  char *path;               /* `<file>.journal`                          */
+  char *file_path;
+  bool started;             /* the writer thread runs                    */
+  uint64_t appended;        /* record bytes appended, recovered included */
+
+  // * shared with the writer thread, under `lock`
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  char *pending;            /* appended, not written yet                 */
+  size_t pending_size;
+  size_t pending_capacity;
+  bool compact;             /* compact down to the records past `compact_cut` */
+  uint64_t compact_cut;
+  Journal_Base compact_base;
+  bool quit;
+
+  // * the writer thread's, once it runs
+  int fd;                   /* -1 while there is no journal file         */
+  Journal_Base base;        /* written into the header of a new journal  */
+  uint64_t file_start;      /* `appended` at the first record in the file */
+  uint64_t file_end;        /* `appended` at the end of the file         */
+  bool dirty;               /* written since the last fsync              */
+  bool failed;              /* a write failed, the journal is given up   */
+} Journal;
+
+Journal_Base journal_base(const char *file_path);
+bool journal_open(Journal *journal, const char *file_path);
+size_t journal_recover(Journal *journal, Editor *editor);
+bool journal_start(Journal *journal);
+void journal_append(Journal *journal, const Editor *editor, Journal_Op op, const char *text);
+void journal_append_at(Journal *journal, Journal_Op op, size_t row, size_t col,
+                       const char *text, size_t size);
+uint64_t journal_mark(const Journal *journal);
+void journal_compact(Journal *journal, uint64_t cut);
+void journal_close(Journal *journal);
+
+#endif // JOURNAL_H_
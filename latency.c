@@ -0,0 +1,108 @@
+#include <assert.h>
+
+#include "latency.h"
+
+const char *latency_stage_names[LATENCY_STAGES] = {
+  [LATENCY_EDIT]    = "edit",
+  [LATENCY_PUBLISH] = "publish",
+  [LATENCY_QUEUE]   = "queue",
+  [LATENCY_DRAW]    = "draw",
+  [LATENCY_TOTAL]   = "total",
+};
+
+static size_t latency_bucket(uint64_t us) {
+  if (us < LATENCY_SUB_BUCKETS) return us;
+
+  const int msb = 63 - __builtin_clzll(us);
+  const int shift = msb - LATENCY_SUB_BITS;
+  // * the bits right below the leading one pick the sub-bucket
+  const size_t sub = (us >> shift) & (LATENCY_SUB_BUCKETS - 1);
+  return (size_t) (shift + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// * Largest value that lands in the bucket
+static uint64_t latency_bucket_high(size_t bucket) {
+  if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+
+  const int shift = (int) (bucket / LATENCY_SUB_BUCKETS) - 1;
+  const uint64_t sub = bucket % LATENCY_SUB_BUCKETS;
+  return ((LATENCY_SUB_BUCKETS + sub) << shift) + ((uint64_t) 1 << shift) - 1;
+}
+
+void latency_record(Latency_Histogram *histogram, uint64_t us) {
+  const uint64_t max = ((uint64_t) 1 << LATENCY_MAX_BITS) - 1;
+  if (us > max) us = max;
+
+  histogram->counts[latency_bucket(us)] += 1;
+  histogram->count += 1;
+  histogram->total_us += us;
+  if (us > histogram->max_us) histogram->max_us = us;
+}
+
+// * Value at the percentile (0..100), 0 for an empty histogram
+uint64_t latency_percentile(const Latency_Histogram *histogram, double percentile) {
+  if (histogram->count == 0) return 0;
+
+  uint64_t rank = (uint64_t) (percentile / 100.0 * histogram->count + 0.5);
+  if (rank < 1) rank = 1;
+  if (rank > histogram->count) rank = histogram->count;
+
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+    seen += histogram->counts[bucket];
+    if (seen >= rank) {
+      const uint64_t high = latency_bucket_high(bucket);
+      return high < histogram->max_us ? high : histogram->max_us;
+    }
+  }
+  return histogram->max_us;
+}
+
+// * Percentile distribution in the spirit of HdrHistogram's text output
+void latency_dump(const Latency_Histogram *histogram, const char *name, FILE *stream) {
+  static const double percentiles[] = {0, 50, 75, 90, 95, 99, 99.9, 99.99, 100};
+
+  fprintf(stream, "== %s ==\n", name);
+  fprintf(stream, "%12s %12s %12s\n", "Value(us)", "Percentile", "TotalCount");
+  for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+    const uint64_t value = latency_percentile(histogram, percentiles[i]);
+    uint64_t below = 0;
+    for (size_t bucket = 0; bucket <= latency_bucket(value); ++bucket) {
+      below += histogram->counts[bucket];
+    }
+    fprintf(stream, "%12llu %12.6f %12llu\n", (unsigned long long) value,
+            percentiles[i] / 100.0, (unsigned long long) below);
+  }
+  fprintf(stream, "#[Mean = %.3f, Max = %llu, Total count = %llu]\n",
+          histogram->count > 0 ? (double) histogram->total_us / histogram->count : 0.0,
+          (unsigned long long) histogram->max_us, (unsigned long long) histogram->count);
+}
+
+bool latency_ring_push(Latency_Ring *ring, Latency_Sample sample) {
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head == LATENCY_RING_CAPACITY) {
+    ring->overflows += 1;
+    return false;
+  }
+
+  ring->samples[tail % LATENCY_RING_CAPACITY] = sample;
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+// * Oldest sample in the ring without removing it, false when empty
+bool latency_ring_peek(Latency_Ring *ring, Latency_Sample *sample) {
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head == tail) return false;
+
+  *sample = ring->samples[head % LATENCY_RING_CAPACITY];
+  return true;
+}
+
+void latency_ring_pop(Latency_Ring *ring) {
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  assert(head != atomic_load_explicit(&ring->tail, memory_order_acquire));
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,69 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define LATENCY_SUB_BITS 7       /* 128 buckets per power of two, < 1% error */
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 36      /* values up to 2^36 us (19 hours)          */
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+/*
+* HDR-style histogram of durations in microseconds: buckets are exact
+* below LATENCY_SUB_BUCKETS and then LATENCY_SUB_BUCKETS per power of two,
+* so any percentile is known to within 1% with a fixed 32 KiB of counters
+* and O(1) recording.
+*/
+typedef struct {
+  uint64_t counts[LATENCY_BUCKETS];
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+} Latency_Histogram;
+
+void latency_record(Latency_Histogram *histogram, uint64_t us);
+uint64_t latency_percentile(const Latency_Histogram *histogram, double percentile);
+void latency_dump(const Latency_Histogram *histogram, const char *name, FILE *stream);
+
+// * Stages a keystroke goes through before it is on screen
+typedef enum {
+  LATENCY_EDIT,        /* event dequeued -> editor mutated          */
+  LATENCY_PUBLISH,     /* editor mutated -> snapshot published      */
+  LATENCY_QUEUE,       /* snapshot published -> render thread takes it */
+  LATENCY_DRAW,        /* render thread takes it -> present returned */
+  LATENCY_TOTAL,       /* event dequeued -> present returned        */
+  LATENCY_STAGES,
+} Latency_Stage;
+
+extern const char *latency_stage_names[LATENCY_STAGES];
+
+// * Timestamps of one keystroke, in SDL_GetPerformanceCounter() ticks
+typedef struct {
+  uint64_t seq;          /* first snapshot that shows it */
+  uint64_t received;
+  uint64_t edited;
+  uint64_t published;
+} Latency_Sample;
+
+#define LATENCY_RING_CAPACITY 1024   /* power of two */
+
+/*
+* Keystrokes on their way from the input thread (pushes) to the render
+* thread (pops once their snapshot, or a later one, is presented).
+* Single producer, single consumer, no locks.
+*/
+typedef struct {
+  Latency_Sample samples[LATENCY_RING_CAPACITY];
+  atomic_size_t head;    /* next to pop  */
+  atomic_size_t tail;    /* next to push */
+  size_t overflows;      /* samples dropped because the ring was full */
+} Latency_Ring;
+
+bool latency_ring_push(Latency_Ring *ring, Latency_Sample sample);
+bool latency_ring_peek(Latency_Ring *ring, Latency_Sample *sample);
+void latency_ring_pop(Latency_Ring *ring);
+
+#endif // LATENCY_H_
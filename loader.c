@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+#include<assert.h>
+#include<stdint.h>
+#include<string.h>
+#include<stdlib.h>
+#include<unistd.h>
+#include<sys/mman.h>
+
+#include "sv.h"
+#include "loader.h"
+#include "rope.h"
+#include "tracing.h"
+
+#define ARRAY_LEN(xs) (sizeof(xs) / sizeof((xs)[0]))
+#define LOADER_NO_NEWLINE SIZE_MAX
+
+/*
+* One slice of the original buffer. A worker finds all its newlines and
+* packs the lines that both start and end inside it into rope leaves.
+* The line crossing into the chunk (up to `first_newline`) is stitched
+* in afterwards, once the chunks before it are known.
+*/
+struct Load_Chunk {
+  size_t begin;             /* first byte of the chunk               */
+  size_t end;               /* one past the last byte                */
+  size_t first_newline;     /* offset of the first '\n' in the chunk */
+  size_t last_newline;      /* offset of the last '\n' in the chunk  */
+  Rope_Node **leaves;       /* lines between first and last newline  */
+  size_t leaves_count;
+  size_t leaves_capacity;
+  atomic_bool indexed;      /* set by the worker once it is done     */
+};
+
+size_t loader_default_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (size_t) n : 1;
+}
+
+static void load_chunk_push_leaf(Load_Chunk *chunk, const Line *lines, size_t count) {
+  if (count == 0) return;
+
+  if (chunk->leaves_count == chunk->leaves_capacity) {
+    chunk->leaves_capacity = chunk->leaves_capacity == 0 ? 16 : chunk->leaves_capacity * 2;
+    chunk->leaves = realloc(chunk->leaves, chunk->leaves_capacity * sizeof(chunk->leaves[0]));
+  }
+  chunk->leaves[chunk->leaves_count++] = rope_leaf_from_lines(lines, count);
+}
+
+static void load_chunk_index(const char *data, Load_Chunk *chunk) {
+  TRACE_ZONE("load_chunk_index");
+  size_t newlines[1024];
+  Line lines[ROPE_LEAF_LINES];
+  size_t lines_count = 0;
+
+  chunk->first_newline = LOADER_NO_NEWLINE;
+  chunk->last_newline = LOADER_NO_NEWLINE;
+
+  size_t scan = chunk->begin;
+  for (;;) {
+    String_View rest = sv_from_parts(data + scan, chunk->end - scan);
+    size_t n = sv_index_all(rest, '\n', newlines, ARRAY_LEN(newlines));
+    for (size_t i = 0; i < n; ++i) {
+      size_t newline = scan + newlines[i];
+      if (chunk->first_newline == LOADER_NO_NEWLINE) {
+        chunk->first_newline = newline;
+      } else {
+        size_t start = chunk->last_newline + 1;
+        lines[lines_count++] = (Line) {
+          .size = newline - start,
+          .gap = newline - start,
+          .chars = (char *) data + start,
+        };
+        if (lines_count == ROPE_LEAF_LINES) {
+          load_chunk_push_leaf(chunk, lines, lines_count);
+          lines_count = 0;
+        }
+      }
+      chunk->last_newline = newline;
+    }
+    if (n < ARRAY_LEN(newlines)) break;
+    scan = chunk->last_newline + 1;
+  }
+
+  load_chunk_push_leaf(chunk, lines, lines_count);
+  atomic_store_explicit(&chunk->indexed, true, memory_order_release);
+}
+
+static void *load_worker(void *arg) {
+  Loader *loader = arg;
+  for (;;) {
+    size_t i = atomic_fetch_add(&loader->next_chunk, 1);
+    if (i >= loader->chunks_count) break;
+    load_chunk_index(loader->data, &loader->chunks[i]);
+  }
+  return NULL;
+}
+
+static void *load_worker_thread(void *arg) {
+  tracing_thread_name("loader");
+  return load_worker(arg);
+}
+
+static void load_append_line(Editor *editor, const char *data, size_t begin, size_t end) {
+  rope_insert(&editor->lines, editor->size, (Line) {
+    .size = end - begin,
+    .gap = end - begin,
+    .chars = (char *) data + begin,
+  });
+  editor->size += 1;
+}
+
+/*
+* Appends the lines of `chunk` after everything stitched so far.
+* `*line_start` is where the line running into the chunk began.
+*/
+static void load_chunk_stitch(Editor *editor, Load_Chunk *chunk, const char *data, size_t *line_start) {
+  if (chunk->first_newline != LOADER_NO_NEWLINE) {
+    load_append_line(editor, data, *line_start, chunk->first_newline);
+    for (size_t i = 0; i < chunk->leaves_count; ++i) {
+      editor->size += chunk->leaves[i]->lines;
+      rope_append_leaf(&editor->lines, chunk->leaves[i]);
+    }
+    *line_start = chunk->last_newline + 1;
+  }
+
+  free(chunk->leaves);
+  chunk->leaves = NULL;
+  chunk->leaves_count = 0;
+}
+
+static void loader_join_workers(Loader *loader) {
+  for (size_t i = 0; i < loader->workers_count; ++i) {
+    pthread_join(loader->workers[i], NULL);
+  }
+  free(loader->workers);
+  loader->workers = NULL;
+  loader->workers_count = 0;
+}
+
+/*
+* Starts indexing the editor's original buffer on `workers` background
+* threads. The editor must be empty; its lines show up as loader_poll
+* is called. With zero workers nothing happens until loader_finish.
+*/
+void loader_start(Loader *loader, Editor *editor, size_t workers) {
+  assert(editor->lines == NULL && editor->size == 0);
+
+  memset(loader, 0, sizeof(*loader));
+  loader->editor = editor;
+  loader->data = editor->original;
+  loader->data_size = editor->original_size;
+  loader->chunks_count = (loader->data_size + LOADER_CHUNK_SIZE - 1) / LOADER_CHUNK_SIZE;
+  loader->chunks = calloc(loader->chunks_count + 1, sizeof(Load_Chunk));
+  for (size_t i = 0; i < loader->chunks_count; ++i) {
+    loader->chunks[i].begin = i * LOADER_CHUNK_SIZE;
+    loader->chunks[i].end = i + 1 < loader->chunks_count ? (i + 1) * LOADER_CHUNK_SIZE : loader->data_size;
+    atomic_init(&loader->chunks[i].indexed, false);
+  }
+  atomic_init(&loader->next_chunk, 0);
+
+  if (editor->original_mapped) {
+    // * the index is one front to back pass, let the kernel read ahead
+    posix_madvise(editor->original, editor->original_size, POSIX_MADV_SEQUENTIAL);
+  }
+
+  if (workers > loader->chunks_count) workers = loader->chunks_count;
+  if (workers > 0) {
+    loader->workers = malloc(workers * sizeof(loader->workers[0]));
+    for (; loader->workers_count < workers; ++loader->workers_count) {
+      if (pthread_create(&loader->workers[loader->workers_count], NULL,
+                         load_worker_thread, loader) != 0) break;
+    }
+  }
+}
+
+/*
+* Appends every chunk indexed so far, in file order, to the editor.
+* Returns true if the editor got new lines. Once the last chunk is in,
+* the workers are joined and `loader->done` is set.
+*/
+bool loader_poll(Loader *loader) {
+  if (loader->done) return false;
+  TRACE_ZONE("loader_poll");
+
+  Editor *editor = loader->editor;
+  size_t size = editor->size;
+  while (loader->chunks_stitched < loader->chunks_count) {
+    Load_Chunk *chunk = &loader->chunks[loader->chunks_stitched];
+    if (!atomic_load_explicit(&chunk->indexed, memory_order_acquire)) break;
+    load_chunk_stitch(editor, chunk, loader->data, &loader->line_start);
+    loader->chunks_stitched += 1;
+  }
+
+  if (loader->chunks_stitched == loader->chunks_count) {
+    // * whatever follows the last newline is the last line
+    load_append_line(editor, loader->data, loader->line_start, loader->data_size);
+
+    loader_join_workers(loader);
+    free(loader->chunks);
+    loader->chunks = NULL;
+    loader->done = true;
+
+    if (editor->original_mapped) {
+      // * editing jumps around, go back to the default page policy
+      posix_madvise(editor->original, editor->original_size, POSIX_MADV_NORMAL);
+    }
+  }
+
+  return editor->size != size;
+}
+
+/*
+* Indexes whatever is left on the calling thread too and waits until the
+* whole file is in the editor
+*/
+void loader_finish(Loader *loader) {
+  if (loader->done) return;
+  TRACE_ZONE("loader_finish");
+
+  load_worker(loader);
+  loader_join_workers(loader);
+  loader_poll(loader);
+  assert(loader->done);
+}
+
+// * Fraction of the file already in the editor, from 0 to 1
+float loader_progress(const Loader *loader) {
+  if (loader->done || loader->data_size == 0) return 1.0f;
+  size_t stitched = loader->chunks_stitched * LOADER_CHUNK_SIZE;
+  return (float) stitched / loader->data_size;
+}
+
+/*
+* Builds all of the editor's lines before returning, using `threads`
+* threads including the calling one
+*/
+void loader_index_lines(Editor *editor, size_t threads) {
+  Loader loader;
+  loader_start(&loader, editor, threads > 0 ? threads - 1 : 0);
+  loader_finish(&loader);
+}
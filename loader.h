@@ -0,0 +1,42 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "editor.h"
+
+#define LOADER_CHUNK_SIZE (4 * 1024 * 1024)  /* bytes indexed per job */
+
+typedef struct Load_Chunk Load_Chunk;
+
+/*
+* Splits the editor's original buffer into lines in the background.
+* Worker threads index LOADER_CHUNK_SIZE chunks of the buffer; the thread
+* that owns the editor appends every finished chunk to the rope in file
+* order from loader_poll, so the editor is never touched by the workers
+* and the loaded prefix can be viewed and edited while the rest is read.
+*/
+typedef struct {
+  Editor *editor;
+  const char *data;          /* the editor's original buffer          */
+  size_t data_size;
+  Load_Chunk *chunks;
+  size_t chunks_count;
+  atomic_size_t next_chunk;  /* next chunk a worker picks up          */
+  size_t chunks_stitched;    /* chunks already appended to the rope   */
+  size_t line_start;         /* start of the line not yet appended    */
+  pthread_t *workers;
+  size_t workers_count;
+  bool done;                 /* every line of the file is in the rope */
+} Loader;
+
+size_t loader_default_threads(void);
+void loader_start(Loader *loader, Editor *editor, size_t workers);
+bool loader_poll(Loader *loader);
+void loader_finish(Loader *loader);
+float loader_progress(const Loader *loader);
+void loader_index_lines(Editor *editor, size_t threads);
+
+#endif // LOADER_H_
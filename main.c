@@ -1,304 +1,1332 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include <SDL.h>
 
 #include "la.h"
 #include "editor.h"
+#include "loader.h"
+#include "render.h"
+#include "surface.h"
+#include "snapshot.h"
+#include "latency.h"
+#include "record.h"
+#include "tracing.h"
+#include "save.h"
+#include "journal.h"
+#include "undo.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#define FONT_DEFAULT_SCALE 5
+#define LINE_CACHE_DEFAULT_MB 64
+#define LOADER_POLL_MS 16
+#define LATENCY_OVERLAY_SCALE 2
+#define LATENCY_PENDING_CAPACITY 256   /* keystrokes between two snapshots */
+#define LOAD_BAR_HEIGHT 4
 
-#define FONT_WIDTH 128
-#define FONT_HEIGHT 64
-#define FONT_COLS 18
-#define FONT_ROWS 7
-#define FONT_CHAR_WIDTH  (FONT_WIDTH / FONT_COLS)
-#define FONT_CHAR_HEIGHT (FONT_HEIGHT / FONT_ROWS)
-#define FONT_SCALE 5
+const int WIDTH = 800;
+const int HEIGHT = 600;
+
+// * Fits the viewport to a `w`x`h` window, counting partially visible cells
+void viewport_resize(Viewport *viewport, int w, int h, int advance, int line_height) {
+  viewport->rows = (size_t) (h / line_height) + 1;
+  viewport->cols = (size_t) (w / advance) + 1;
+}
+
+// * Scrolls just enough for the cell under the cursor to be fully visible
+void viewport_follow(Viewport *viewport, size_t row, size_t col) {
+  // * the last row and column may be cut by the window edge
+  size_t full_rows = viewport->rows > 1 ? viewport->rows - 1 : 1;
+  size_t full_cols = viewport->cols > 1 ? viewport->cols - 1 : 1;
+
+  if (row < viewport->row) viewport->row = row;
+  if (row >= viewport->row + full_rows) viewport->row = row - full_rows + 1;
+  if (col < viewport->col) viewport->col = col;
+  if (col >= viewport->col + full_cols) viewport->col = col - full_cols + 1;
+}
+
+// #define BUFFER_CAPACITY 1024
+// char buffer[BUFFER_CAPACITY];
+// size_t buffer_cursor = 0;
+// size_t buffer_size = 0;
+
+Editor editor = {0};
+// * nothing to load until a file is opened
+Loader loader = {.done = true};
+// * zoom level, changed with Ctrl +/- and reset with Ctrl 0
+int font_scale = FONT_DEFAULT_SCALE;
+// * the background save started with F2
+Save_Job save_job = {0};
+// * the edits since the last save, in case te does not live to the next one
+Journal journal = {.fd = -1};
+// * what Ctrl+Z takes back, the editor records into it once the journal is replayed
+Undo_History history = {0};
+
+#define UNHEX(color)               \
+  ((color) >> (8 * 0)) & 0xFF,     \
+      ((color) >> (8 * 1)) & 0xFF, \
+      ((color) >> (8 * 2)) & 0xFF, \
+      ((color) >> (8 * 3)) & 0xFF
+
+// * Renders the cursor
+void render_cursor(SDL_Renderer *renderer, Glyph_Batch *batch, const Font_Scale *glyphs, const Snapshot *snapshot, Uint32 color) {
+  const Viewport *viewport = &snapshot->viewport;
+  if (snapshot->cursor_row < viewport->row || snapshot->cursor_row >= viewport->row + viewport->rows) return;
+  if (snapshot->cursor_col < viewport->col || snapshot->cursor_col >= viewport->col + viewport->cols) return;
+
+  const SDL_Rect rect = {
+      .x = (int)(snapshot->cursor_col - viewport->col) * glyphs->advance,
+      .y = (int)(snapshot->cursor_row - viewport->row) * glyphs->line_height,
+      .w = glyphs->advance,
+      .h = glyphs->line_height};
+
+  scc(SDL_SetRenderDrawColor(renderer, UNHEX(color)));
+  scc(SDL_RenderFillRect(renderer, &rect));
+
+  
+  // * Render the overlapping character on cursor rect
+  if (snapshot->cursor_char) {
+    // * black on top of the cursor rect
+    glyph_batch_push(batch, glyphs, snapshot->cursor_char, rect.x, rect.y, 0xFF000000);
+    glyph_batch_flush(batch, renderer);
+  }
+}
+
+// * Thin bar along the bottom of the window showing how much of the file is loaded
+void render_load_progress(SDL_Renderer *renderer, const Snapshot *snapshot, Uint32 color) {
+  const int w = snapshot->width;
+  const int h = snapshot->height;
 
-void scc(int code) {
-  if (code < 0) {
-    fprintf(stderr, "SDL ERROR: %s\n", SDL_GetError());
-    exit(1);
+  const SDL_Rect track = {.x = 0, .y = h - LOAD_BAR_HEIGHT, .w = w, .h = LOAD_BAR_HEIGHT};
+  const SDL_Rect bar = {.x = 0, .y = h - LOAD_BAR_HEIGHT,
+                        .w = (int)(w * snapshot->load_progress), .h = LOAD_BAR_HEIGHT};
+
+  scc(SDL_SetRenderDrawColor(renderer, 0x40, 0x40, 0x40, 0xFF));
+  scc(SDL_RenderFillRect(renderer, &track));
+  scc(SDL_SetRenderDrawColor(renderer, UNHEX(color)));
+  scc(SDL_RenderFillRect(renderer, &bar));
+}
+
+double elapsed_ms(Uint64 since) {
+  return (double)(SDL_GetPerformanceCounter() - since) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// * Redraws the damaged rows of the snapshot into the frame texture
+void render_damage(SDL_Renderer *renderer,
+                   SDL_Texture *frame,
+                   Glyph_Batch *batch,
+                   Line_Cache *line_cache,
+                   const Font_Scale *glyphs,
+                   const Snapshot *snapshot,
+                   const Damage *damage)
+{
+  TRACE_ZONE("render_damage");
+  const Viewport *viewport = &snapshot->viewport;
+  scc(SDL_SetRenderTarget(renderer, frame));
+  scc(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0));
+
+  size_t begin = viewport->row;
+  size_t end = viewport->row + viewport->rows;
+  if (damage->all) {
+    scc(SDL_RenderClear(renderer));
+  } else {
+    if (damage->begin > begin) begin = damage->begin;
+    if (damage->end < end) end = damage->end;
   }
+
+  const int row_height = glyphs->line_height;
+  for (size_t row = begin; row < end; ++row) {
+    const int y = (int) (row - viewport->row) * row_height;
+    if (!damage->all) {
+      const SDL_Rect rect = {
+        .x = 0,
+        .y = y,
+        .w = (int) viewport->cols * glyphs->advance,
+        .h = row_height,
+      };
+      scc(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0));
+      scc(SDL_RenderFillRect(renderer, &rect));
+    }
+    const Snapshot_Row *text = snapshot->rows[row - viewport->row];
+    if (text != NULL) {
+      // * the row holds the visible columns only
+      line_cache_render(line_cache, renderer, batch, glyphs, &text->line,
+                        0, text->line.size, 0, y, 0xFFFFFFFF);
+    }
+  }
+  glyph_batch_flush(batch, renderer);
+
+  if (snapshot->cursor_row >= begin && snapshot->cursor_row < end) {
+    render_cursor(renderer, batch, glyphs, snapshot, 0xFFFFFFFF);
+  }
+
+  scc(SDL_SetRenderTarget(renderer, NULL));
 }
 
-void *scp(void *ptr) {
-  if (ptr == NULL) {
-    fprintf(stderr, "SDL ERROR: %s\n", SDL_GetError());
-    exit(1);
+// * The lines of the latency overlay, returns how many
+size_t latency_overlay_lines(const Latency_Histogram *latency, char lines[][64]) {
+  size_t count = 0;
+  snprintf(lines[count++], 64, "keystrokes %-8llu     p50     p99     max ms",
+           (unsigned long long) latency[LATENCY_TOTAL].count);
+  for (size_t stage = 0; stage < LATENCY_STAGES; ++stage) {
+    const Latency_Histogram *histogram = &latency[stage];
+    snprintf(lines[count++], 64, "%-18s %7.2f %7.2f %7.2f", latency_stage_names[stage],
+             latency_percentile(histogram, 50) / 1000.0,
+             latency_percentile(histogram, 99) / 1000.0,
+             histogram->max_us / 1000.0);
   }
-  return ptr;
+  return count;
 }
 
-const int WIDTH = 800;
-const int HEIGHT = 600;
+// * Top right corner of the window, where the overlay goes
+SDL_Rect latency_overlay_rect(int window_w, int advance, int line_height, size_t lines, size_t cols) {
+  const int padding = advance;
+  const int w = (int) cols * advance + 2 * padding;
+  return (SDL_Rect) {
+    .x = window_w - w,
+    .y = 0,
+    .w = w,
+    .h = (int) lines * line_height + 2 * padding,
+  };
+}
 
-// * Create an SDL_Surface from a image
-SDL_Surface *surface_from_file(const char *filepath) {
-  int width, height, n;
-  int req_format = STBI_rgb_alpha;
-  unsigned char *pixels = stbi_load(filepath, &width, &height, &n, req_format);
-  if (pixels == NULL) {
-    fprintf(stderr, "ERROR: could not load file %s: %s\n", filepath, stbi_failure_reason());
+// * p50/p99/max of every stage on top of the frame, toggled with F3
+void render_latency_overlay(SDL_Renderer *renderer, Glyph_Batch *batch, const Font_Scale *glyphs,
+                            const Snapshot *snapshot, const Latency_Histogram *latency) {
+  char lines[LATENCY_STAGES + 1][64];
+  const size_t count = latency_overlay_lines(latency, lines);
+  const SDL_Rect rect = latency_overlay_rect(snapshot->width, glyphs->advance, glyphs->line_height,
+                                             count, strlen(lines[0]));
+
+  scc(SDL_SetRenderDrawColor(renderer, 0x20, 0x20, 0x20, 0xFF));
+  scc(SDL_RenderFillRect(renderer, &rect));
+  for (size_t i = 0; i < count; ++i) {
+    render_text_sized(batch, glyphs, lines[i], strlen(lines[i]), rect.x + glyphs->advance,
+                      rect.y + glyphs->advance + (int) i * glyphs->line_height, 0xFF00FFFF);
   }
+  glyph_batch_flush(batch, renderer);
+}
 
-  
-  Uint32 rmask, gmask, bmask, amask;
-  /* SDL interprets each pixel as a 32-bit number, so our masks must depend
-     on the endianness (byte order) of the machine */
-  #if SDL_BYTEORDER == SDL_BIG_ENDIAN
-    rmask = 0xff000000;
-    gmask = 0x00ff0000;
-    bmask = 0x0000ff00;
-    amask = 0x000000ff;
-  #else
-    rmask = 0x000000ff;
-    gmask = 0x0000ff00;
-    bmask = 0x00ff0000;
-    amask = 0xff000000;
-  #endif
-
-  const int depth = 32;
-  const int pitch = 4 * width;
-
-  return scp(SDL_CreateRGBSurfaceFrom((void *)pixels,
-                                      width, height,
-                                      depth, pitch,
-                                      rmask, gmask, bmask, amask));
+// * Bottom right corner of the window, above the load progress bar, where the status goes
+SDL_Rect status_rect(int window_w, int window_h, int advance, int line_height, size_t cols) {
+  const int padding = advance;
+  const int w = (int) cols * advance + 2 * padding;
+  const int h = line_height + 2 * padding;
+  return (SDL_Rect) {
+    .x = window_w - w,
+    .y = window_h - LOAD_BAR_HEIGHT - h,
+    .w = w,
+    .h = h,
+  };
+}
+
+// * The status line (a save in progress, done or failed) on top of the frame
+void render_status(SDL_Renderer *renderer, Glyph_Batch *batch, const Font_Scale *glyphs,
+                   const Snapshot *snapshot) {
+  const size_t count = strlen(snapshot->status);
+  const SDL_Rect rect = status_rect(snapshot->width, snapshot->height, glyphs->advance,
+                                    glyphs->line_height, count);
+
+  scc(SDL_SetRenderDrawColor(renderer, 0x20, 0x20, 0x20, 0xFF));
+  scc(SDL_RenderFillRect(renderer, &rect));
+  render_text_sized(batch, glyphs, snapshot->status, count, rect.x + glyphs->advance,
+                    rect.y + glyphs->advance, snapshot->status_error ? 0xFF0000FF : 0xFF00FFFF);
+  glyph_batch_flush(batch, renderer);
+}
+
+// * Clips the rect to the surface, false when nothing is left
+bool surface_clip_rect(const SDL_Surface *surface, SDL_Rect *rect) {
+  if (rect->x < 0) { rect->w += rect->x; rect->x = 0; }
+  if (rect->y < 0) { rect->h += rect->y; rect->y = 0; }
+  if (rect->x + rect->w > surface->w) rect->w = surface->w - rect->x;
+  if (rect->y + rect->h > surface->h) rect->h = surface->h - rect->y;
+  return rect->w > 0 && rect->h > 0;
 }
 
-#define ASCII_DISPLAY_LOW 32
-#define ASCII_DISPLAY_HIGH 126
+/*
+* Software counterpart of render_damage: redraws the damaged rows (and the
+* load progress bar, the status and the latency overlay, unless `latency` is NULL)
+* straight into the window surface, which keeps its pixels between
+* frames, and pushes only those rows to the screen
+*/
+void surface_render_damage(SDL_Window *window,
+                           const Surface_Font *font,
+                           const Snapshot *snapshot,
+                           const Damage *damage,
+                           const Surface_Font *overlay_font,
+                           const Latency_Histogram *latency)
+{
+  TRACE_ZONE("surface_render_damage");
+  const Viewport *viewport = &snapshot->viewport;
+  SDL_Surface *surface = scp(SDL_GetWindowSurface(window));
+  const Uint32 background = surface_map_color(surface, 0xFF000000);
+  const Uint32 foreground = surface_map_color(surface, 0xFFFFFFFF);
+
+  size_t begin = viewport->row;
+  size_t end = viewport->row + viewport->rows;
+  if (!damage->all) {
+    if (damage->begin > begin) begin = damage->begin;
+    if (damage->end < end) end = damage->end;
+  }
+
+  SDL_Rect rects[4];
+  int rects_count = 0;
 
+  const int row_height = font->line_height;
+  if (begin < end) {
+    SDL_Rect rows = {
+      .x = 0,
+      .y = (int) (begin - viewport->row) * row_height,
+      .w = surface->w,
+      .h = (int) (end - begin) * row_height,
+    };
+    if (damage->all) rows = (SDL_Rect) {.x = 0, .y = 0, .w = surface->w, .h = surface->h};
+    if (surface_clip_rect(surface, &rows)) {
+      scc(SDL_FillRect(surface, &rows, background));
+      rects[rects_count++] = rows;
+    }
+  }
+
+  const bool cursor_damaged = snapshot->cursor_row >= begin && snapshot->cursor_row < end
+    && snapshot->cursor_col >= viewport->col && snapshot->cursor_col < viewport->col + viewport->cols;
+  SDL_Rect cursor = {
+    .x = (int) (snapshot->cursor_col - viewport->col) * font->advance,
+    .y = (int) (snapshot->cursor_row - viewport->row) * row_height,
+    .w = font->advance,
+    .h = row_height,
+  };
+  if (cursor_damaged) {
+    scc(SDL_FillRect(surface, &cursor, foreground));
+  }
+
+  if (SDL_MUSTLOCK(surface)) scc(SDL_LockSurface(surface));
+  for (size_t row = begin; row < end; ++row) {
+    const Snapshot_Row *text = snapshot->rows[row - viewport->row];
+    if (text == NULL) break;
+    const int y = (int) (row - viewport->row) * row_height;
+    surface_render_text(surface, font, text->text, text->line.size, 0, y, foreground);
+  }
+  if (cursor_damaged && snapshot->cursor_char) {
+    // * black on top of the cursor rect
+    surface_render_text(surface, font, &snapshot->cursor_char, 1, cursor.x, cursor.y, background);
+  }
+  if (SDL_MUSTLOCK(surface)) SDL_UnlockSurface(surface);
+
+  if (snapshot->loading) {
+    SDL_Rect track = {.x = 0, .y = surface->h - LOAD_BAR_HEIGHT, .w = surface->w, .h = LOAD_BAR_HEIGHT};
+    SDL_Rect bar = {.x = 0, .y = surface->h - LOAD_BAR_HEIGHT,
+                    .w = (int)(surface->w * snapshot->load_progress), .h = LOAD_BAR_HEIGHT};
+    if (surface_clip_rect(surface, &track)) {
+      scc(SDL_FillRect(surface, &track, surface_map_color(surface, 0xFF404040)));
+      if (surface_clip_rect(surface, &bar)) {
+        scc(SDL_FillRect(surface, &bar, foreground));
+      }
+      rects[rects_count++] = track;
+    }
+  }
+
+  if (snapshot->status[0] != '\0') {
+    const size_t count = strlen(snapshot->status);
+    SDL_Rect rect = status_rect(surface->w, surface->h, overlay_font->advance, overlay_font->line_height, count);
+    if (surface_clip_rect(surface, &rect)) {
+      scc(SDL_FillRect(surface, &rect, surface_map_color(surface, 0xFF202020)));
+      if (SDL_MUSTLOCK(surface)) scc(SDL_LockSurface(surface));
+      surface_render_text(surface, overlay_font, snapshot->status, count,
+                          rect.x + overlay_font->advance, rect.y + overlay_font->advance,
+                          surface_map_color(surface, snapshot->status_error ? 0xFF0000FF : 0xFF00FFFF));
+      if (SDL_MUSTLOCK(surface)) SDL_UnlockSurface(surface);
+      rects[rects_count++] = rect;
+    }
+  }
+
+  if (latency != NULL) {
+    char lines[LATENCY_STAGES + 1][64];
+    const size_t count = latency_overlay_lines(latency, lines);
+    SDL_Rect rect = latency_overlay_rect(surface->w, overlay_font->advance, overlay_font->line_height,
+                                         count, strlen(lines[0]));
+    if (surface_clip_rect(surface, &rect)) {
+      scc(SDL_FillRect(surface, &rect, surface_map_color(surface, 0xFF202020)));
+      if (SDL_MUSTLOCK(surface)) scc(SDL_LockSurface(surface));
+      for (size_t i = 0; i < count; ++i) {
+        surface_render_text(surface, overlay_font, lines[i], strlen(lines[i]),
+                            rect.x + overlay_font->advance,
+                            rect.y + overlay_font->advance + (int) i * overlay_font->line_height,
+                            surface_map_color(surface, 0xFF00FFFF));
+      }
+      if (SDL_MUSTLOCK(surface)) SDL_UnlockSurface(surface);
+      rects[rects_count++] = rect;
+    }
+  }
+
+  if (rects_count > 0) {
+    TRACE_ZONE("SDL_UpdateWindowSurfaceRects");
+    scc(SDL_UpdateWindowSurfaceRects(window, rects, rects_count));
+  }
+}
+
+// * Running count, mean and maximum of a duration
+typedef struct {
+  size_t count;
+  double total_ms;
+  double max_ms;
+} Timing;
+
+void timing_add(Timing *timing, double ms) {
+  timing->count += 1;
+  timing->total_ms += ms;
+  if (ms > timing->max_ms) timing->max_ms = ms;
+}
+
+void timing_report(const char *name, const Timing *timing, FILE *stream) {
+  fprintf(stream, "  %-22s %8zu  avg %7.3f ms  max %7.3f ms\n", name, timing->count,
+          timing->count > 0 ? timing->total_ms / timing->count : 0.0, timing->max_ms);
+}
+
+/*
+* The render thread owns everything that draws: the renderer (or the
+* window surface), the font atlases, the line cache and the frame
+* texture. It only ever sees the editor through published snapshots, so
+* a slow frame never holds up input and a burst of input never holds up
+* a frame. Counters are written by the render thread and read once it
+* has been joined.
+*/
 typedef struct {
-  SDL_Texture *spritesheet;
-  SDL_Rect glyph_table[ASCII_DISPLAY_HIGH - ASCII_DISPLAY_LOW + 1];
-} Font;
+  SDL_Window *window;
+  Snapshot_Buffer snapshots;
+  atomic_bool quit;
+  bool software;
+  size_t line_cache_mb;
+  bool line_cache_stats;
+  bool load_timings;
+  Uint64 start;             /* when te started, for load timings        */
+  size_t frames_rendered;
+  size_t frames_skipped;    /* wakeups that needed no drawing           */
+  size_t snapshots_dropped; /* replaced before the render thread saw them */
+  Timing frame_times;       /* drawing and presenting a frame           */
+  Timing snapshot_ages;     /* snapshot taken to frame presented        */
+  Latency_Ring keystrokes;  /* pushed by the input thread               */
+  Latency_Histogram latency[LATENCY_STAGES];
+} Render_Thread;
+
+uint64_t ticks_to_us(Uint64 ticks) {
+  return (uint64_t) ((double) ticks * 1e6 / SDL_GetPerformanceFrequency());
+}
+
+/*
+* Records the keystrokes that are on screen now that the snapshot `seq`
+* (taken from the buffer at `acquired`) is: its own and those of any
+* snapshot it replaced.
+*/
+void render_thread_record_latency(Render_Thread *rt, uint64_t seq, Uint64 acquired) {
+  const Uint64 presented = SDL_GetPerformanceCounter();
+  Latency_Sample sample;
+  while (latency_ring_peek(&rt->keystrokes, &sample) && sample.seq <= seq) {
+    latency_ring_pop(&rt->keystrokes);
+    const Uint64 taken = acquired > sample.published ? acquired : sample.published;
+    latency_record(&rt->latency[LATENCY_EDIT], ticks_to_us(sample.edited - sample.received));
+    latency_record(&rt->latency[LATENCY_PUBLISH], ticks_to_us(sample.published - sample.edited));
+    latency_record(&rt->latency[LATENCY_QUEUE], ticks_to_us(taken - sample.published));
+    latency_record(&rt->latency[LATENCY_DRAW], ticks_to_us(presented - taken));
+    latency_record(&rt->latency[LATENCY_TOTAL], ticks_to_us(presented - sample.received));
+  }
+}
 
-Font font_load_from_file(SDL_Renderer *renderer, const char *file_path) {
+void *render_thread(void *arg) {
+  Render_Thread *rt = arg;
+  tracing_thread_name("render");
+
+  SDL_Renderer *renderer = NULL;
   Font font = {0};
+  Surface_Font surface_font = {0};
+  Surface_Font overlay_font = {0};
+  if (!rt->software) {
+    renderer = scp(SDL_CreateRenderer(rt->window, -1, SDL_RENDERER_PRESENTVSYNC));
+    font = font_load(renderer);
+  }
+  Glyph_Batch batch = {0};
+  Line_Cache line_cache;
+  line_cache_init(&line_cache, rt->line_cache_mb * 1024 * 1024);
+  SDL_Texture *frame = NULL;
+  int frame_w = 0, frame_h = 0;
+
+  // * what the frame shows: the last drawn snapshot (without its rows) and its row ids
+  Snapshot drawn = {0};
+  uint64_t *drawn_ids = NULL;
+  size_t drawn_ids_capacity = 0;
+  bool first_paint = false;
+
+  for (;;) {
+    snapshot_wait(&rt->snapshots);
+    if (atomic_load(&rt->quit)) break;
+
+    const Snapshot *snapshot = snapshot_acquire(&rt->snapshots);
+    if (snapshot == NULL || snapshot->seq == drawn.seq) {
+      rt->frames_skipped += 1;
+      continue;
+    }
+    const Uint64 frame_start = SDL_GetPerformanceCounter();
+    TRACE_ZONE("frame");
+    if (drawn.seq != 0) rt->snapshots_dropped += snapshot->seq - drawn.seq - 1;
+
+    Damage damage = {0};
+    if (snapshot->target_resets != drawn.target_resets || snapshot->device_resets != drawn.device_resets) {
+      // * the cached textures are gone with the old targets
+      line_cache_clear(&line_cache);
+      if (snapshot->device_resets != drawn.device_resets) {
+        font_drop_atlases(&font);
+      }
+      if (frame) SDL_DestroyTexture(frame);
+      frame = NULL;
+    }
+
+    const Viewport *viewport = &snapshot->viewport;
+    if (drawn.seq == 0
+        || snapshot->redraws != drawn.redraws
+        || snapshot->latency_overlay != drawn.latency_overlay
+        || snapshot->font_scale != drawn.font_scale
+        || memcmp(viewport, &drawn.viewport, sizeof(*viewport)) != 0) {
+      damage.all = true;
+    } else {
+      // * a shared row is unchanged, only rows with new ids and the cursor move are drawn
+      for (size_t i = 0; i < viewport->rows; ++i) {
+        const uint64_t id = snapshot->rows[i] ? snapshot->rows[i]->id : 0;
+        if (id != drawn_ids[i]) damage_row(&damage, viewport->row + i);
+      }
+      if (snapshot->cursor_row != drawn.cursor_row || snapshot->cursor_col != drawn.cursor_col) {
+        damage_row(&damage, drawn.cursor_row);
+        damage_row(&damage, snapshot->cursor_row);
+      }
+    }
+
+    if (!rt->software && (frame == NULL || snapshot->width != frame_w || snapshot->height != frame_h)) {
+      if (frame) SDL_DestroyTexture(frame);
+      frame = scp(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET,
+                                    snapshot->width, snapshot->height));
+      // * the frame is cleared to transparent, blending it would keep the last frame's
+      // * progress bar and status box showing through
+      scc(SDL_SetTextureBlendMode(frame, SDL_BLENDMODE_NONE));
+      frame_w = snapshot->width;
+      frame_h = snapshot->height;
+      damage.all = true;
+    }
+    // * a finished load takes the progress bar along with it
+    if (rt->software && drawn.loading && !snapshot->loading) damage.all = true;
+    // * a changed or cleared status leaves its old box behind
+    const bool status_changed = strcmp(snapshot->status, drawn.status) != 0;
+    if (rt->software && status_changed) damage.all = true;
+    // * the progress bar moves while loading, the status is drawn over the frame
+    const bool present = snapshot->loading || drawn.loading || status_changed;
 
-  SDL_Surface *font_surface = surface_from_file(file_path);
-  scc(SDL_SetColorKey(font_surface, SDL_TRUE, 0xFF000000)); // * transparent color
+    if (drawn_ids_capacity < viewport->rows) {
+      uint64_t *ids = realloc(drawn_ids, viewport->rows * sizeof(*ids));
+      if (ids == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu row ids\n", viewport->rows);
+        exit(1);
+      }
+      drawn_ids = ids;
+      drawn_ids_capacity = viewport->rows;
+    }
+    for (size_t i = 0; i < viewport->rows; ++i) {
+      drawn_ids[i] = snapshot->rows[i] ? snapshot->rows[i]->id : 0;
+    }
+    drawn = *snapshot;
+    drawn.rows = NULL;
 
-  font.spritesheet = scp(SDL_CreateTextureFromSurface(renderer, font_surface));
+    if (!damage_any(&damage) && !present) {
+      // * nothing to draw, but the keystrokes are on screen already
+      render_thread_record_latency(rt, snapshot->seq, frame_start);
+      rt->frames_skipped += 1;
+      continue;
+    }
 
-  // * Free the SDL_Surface
-  SDL_FreeSurface(font_surface);
+    if (rt->software) {
+      surface_font_set_scale(&surface_font, snapshot->font_scale);
+      surface_font_set_scale(&overlay_font, LATENCY_OVERLAY_SCALE);
+      surface_render_damage(rt->window, &surface_font, snapshot, &damage,
+                            &overlay_font, snapshot->latency_overlay ? rt->latency : NULL);
+    } else {
+      const Font_Scale *glyphs = font_at_scale(&font, snapshot->font_scale);
+      if (damage_any(&damage)) {
+        render_damage(renderer, frame, &batch, &line_cache, glyphs, snapshot, &damage);
+      }
 
-  // * Pre calculate all the glyphs rects
-  for (size_t ascii = ASCII_DISPLAY_LOW; ascii <= ASCII_DISPLAY_HIGH; ++ascii) {
-    const size_t index = ascii - ASCII_DISPLAY_LOW;
-    const size_t col = index % FONT_COLS;
-    const size_t row = index / FONT_COLS;
+      scc(SDL_RenderCopy(renderer, frame, NULL, NULL));
+      if (snapshot->loading) {
+        render_load_progress(renderer, snapshot, 0xFFFFFFFF);
+      }
+      if (snapshot->latency_overlay) {
+        render_latency_overlay(renderer, &batch, font_at_scale(&font, LATENCY_OVERLAY_SCALE),
+                               snapshot, rt->latency);
+      }
+      if (snapshot->status[0] != '\0') {
+        render_status(renderer, &batch, font_at_scale(&font, LATENCY_OVERLAY_SCALE), snapshot);
+      }
 
-    // printf("index: %zu, col: %zu, row: %zu\n", index, col, row);
+      TRACE_ZONE("SDL_RenderPresent");
+      SDL_RenderPresent(renderer);
+    }
+    render_thread_record_latency(rt, snapshot->seq, frame_start);
+    rt->frames_rendered += 1;
+    timing_add(&rt->frame_times, elapsed_ms(frame_start));
+    timing_add(&rt->snapshot_ages, elapsed_ms(snapshot->taken));
 
-    font.glyph_table[index] = (SDL_Rect){
-        .x = col * FONT_CHAR_WIDTH,
-        .y = row * FONT_CHAR_HEIGHT,
-        .w = FONT_CHAR_WIDTH,
-        .h = FONT_CHAR_HEIGHT};
+    // * the first paint counts once a whole screen of lines (or the whole file) is there
+    if (rt->load_timings && !first_paint && (!snapshot->loading || snapshot->lines >= viewport->rows)) {
+      first_paint = true;
+      printf("time to first paint: %.2f ms (%zu lines loaded)\n", elapsed_ms(rt->start), snapshot->lines);
+    }
   }
 
-  return font;
+  if (rt->line_cache_stats) {
+    line_cache_report(&line_cache, stdout);
+  }
+  line_cache_free(&line_cache);
+  glyph_batch_free(&batch);
+  free(drawn_ids);
+  if (frame) SDL_DestroyTexture(frame);
+  font_drop_atlases(&font);
+  surface_font_free(&surface_font);
+  surface_font_free(&overlay_font);
+  if (renderer) SDL_DestroyRenderer(renderer);
+  return NULL;
 }
 
-void render_char(SDL_Renderer *renderer,
-                 const Font *font,
-                 char c,
-                 Vec2f pos,
-                 float scale)
-{
+/*
+* What the input thread keeps next to the editor: the view, what changed
+* since the last snapshot and what the render thread has to be told
+*/
+typedef struct {
+  bool quit;
+  bool publish;             /* the render thread needs a new snapshot     */
+  bool follow_cursor;       /* scroll to the cursor once the batch is done */
+  Damage damage;            /* rows edited since the last snapshot        */
+  Viewport viewport;
+  int width;                /* window size                                */
+  int height;
+  unsigned redraws;
+  unsigned target_resets;
+  unsigned device_resets;
+  bool latency_overlay;
+  const char *file_path;    /* F2 saves here                              */
+  bool save_requested;      /* F2 was pressed, save once the last save is over */
+  uint64_t save_cut;        /* journal_mark when the last save started    */
+  Save_State save_state;    /* of the last save, as the status shows it   */
+  char status[SNAPSHOT_STATUS_SIZE];
+  bool status_error;
+} Input;
 
-  const SDL_Rect dst = {
-      .x = (int)floorf(pos.x),
-      .y = (int)floorf(pos.y),
-      .w = (int)floorf(FONT_CHAR_WIDTH * scale),
-      .h = (int)floorf(FONT_CHAR_HEIGHT * scale)};
+// * Shows a new status, the render thread only hears of it when it changed
+void input_set_status(Input *input, bool error, const char *format, ...) {
+  char status[SNAPSHOT_STATUS_SIZE];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(status, sizeof(status), format, args);
+  va_end(args);
 
-  assert(c >= ASCII_DISPLAY_LOW);
-  assert(c <= ASCII_DISPLAY_HIGH);
-  const size_t index = c - ASCII_DISPLAY_LOW;
-  scc(SDL_RenderCopy(renderer, font->spritesheet, &font->glyph_table[index], &dst));
+  if (strcmp(status, input->status) == 0 && error == input->status_error) return;
+  memcpy(input->status, status, sizeof(status));
+  input->status_error = error;
+  input->publish = true;
 }
 
-void set_texture_color(SDL_Texture *texture, Uint32 color) {
-  // * set texture rgb color
-  SDL_SetTextureColorMod(texture,
-                         (color >> (8 * 0) & 0xFF),
-                         (color >> (8 * 1) & 0xFF),
-                         (color >> (8 * 2) & 0xFF));
+// * Typing dismisses the status of a finished save
+void input_clear_status(Input *input) {
+  if (input->save_state == SAVE_RUNNING || input->save_requested || input->status[0] == '\0') return;
+  input->status[0] = '\0';
+  input->publish = true;
+}
+
+/*
+* Journals every change undo and redo make, at the exact place they make
+* it, and damages the rows it touches
+*/
+void input_undo_change(void *data, const Undo_Change *change) {
+  Input *input = data;
+  static const Journal_Op ops[] = {
+    [UNDO_INSERT_TEXT] = JOURNAL_INSERT_AT,
+    [UNDO_REMOVE_TEXT] = JOURNAL_REMOVE_AT,
+    [UNDO_INSERT_LINE] = JOURNAL_INSERT_LINE_AT,
+    [UNDO_REMOVE_LINE] = JOURNAL_REMOVE_LINE_AT,
+  };
+  journal_append_at(&journal, ops[change->kind], change->row, change->col, change->text, change->size);
 
-  // * set texture alpha color
-  scc(SDL_SetTextureAlphaMod(texture, (color >> (8 * 3) & 0xFF)));
+  if (change->kind == UNDO_INSERT_TEXT || change->kind == UNDO_REMOVE_TEXT) {
+    damage_row(&input->damage, change->row);
+  } else {
+    damage_rows(&input->damage, change->row, SIZE_MAX);
+  }
 }
 
-void render_text_sized(SDL_Renderer *renderer,
-                       Font *font,
-                       const char *text,
-                       size_t text_size,
-                       Vec2f pos,
-                       Uint32 color,
-                       float scale)
-{
+/*
+* Turns Ctrl+V into a paste event that carries the clipboard text. A
+* recording keeps what was pasted, and a replay pastes that again
+* instead of whatever the clipboard holds by then.
+*/
+void input_capture_paste(SDL_Event *event) {
+  if (event->type != SDL_KEYDOWN || event->key.keysym.sym != SDLK_v) return;
+  if (!(event->key.keysym.mod & KMOD_CTRL)) return;
 
-  set_texture_color(font->spritesheet, color);
-  Vec2f pen = pos;
-  for (size_t i = 0; i < text_size; ++i) {
-    // printf("text[i]: %c\n", text[i]);
-    render_char(renderer, font, text[i], pen, scale);
-    pen.x += FONT_CHAR_WIDTH * scale;
+  char *clipboard = SDL_GetClipboardText();
+  const size_t size = clipboard ? strlen(clipboard) : 0;
+  char *text = malloc(size + 1);
+  if (text == NULL) {
+    fprintf(stderr, "ERROR: could not allocate %zu bytes for the paste\n", size + 1);
+    SDL_free(clipboard);
+    return;
   }
+  if (size > 0) memcpy(text, clipboard, size);
+  text[size] = '\0';
+  SDL_free(clipboard);
+
+  memset(event, 0, sizeof(*event));
+  event->type = RECORD_PASTE_EVENT;
+  event->user.data1 = text;
 }
 
+/*
+* A paste goes in as if it was typed, a newline in it as if it was
+* Enter, and one undo takes all of it back. `text` is cut into lines in
+* place.
+*/
+void input_paste(char *text) {
+  TRACE_ZONE("input_paste");
+  if (text == NULL || *text == '\0') return;
+  undo_group_begin(&history);
+  char *line = text;
+  for (;;) {
+    char *end = strchr(line, '\n');
+    if (end != NULL) {
+      *end = '\0';
+      if (end > line && end[-1] == '\r') end[-1] = '\0';
+    }
+    if (*line != '\0') {
+      journal_append(&journal, &editor, JOURNAL_INSERT, line);
+      editor_insert_text_before_cursor(&editor, line);
+    }
+    if (end == NULL) break;
+    journal_append(&journal, &editor, JOURNAL_NEWLINE, NULL);
+    editor_insert_new_line(&editor);
+    line = end + 1;
+  }
+  undo_group_end(&history);
+}
 
-// #define BUFFER_CAPACITY 1024
-// char buffer[BUFFER_CAPACITY];
-// size_t buffer_cursor = 0;
-// size_t buffer_size = 0;
+/*
+* Applies one event to the editor and the input state. Live and
+* replayed events go through here alike.
+*/
+void handle_event(Input *input, const SDL_Event *event) {
+  TRACE_ZONE("handle_event");
+  const size_t row_before = editor.cursor_row;
+  const size_t size_before = editor.size;
+  bool cursor_moved = false;
 
-Editor editor = {0};
+  switch (event->type) {
+    case SDL_QUIT: {
+      input->quit = true;
+    } break;
 
-#define UNHEX(color)               \
-  ((color) >> (8 * 0)) & 0xFF,     \
-      ((color) >> (8 * 1)) & 0xFF, \
-      ((color) >> (8 * 2)) & 0xFF, \
-      ((color) >> (8 * 3)) & 0xFF
+    case SDL_WINDOWEVENT: {
+      // * exposed, resized, restored...: the window content may be gone
+      if (event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+        input->width = event->window.data1;
+        input->height = event->window.data2;
+      }
+      input->redraws += 1;
+      input->publish = true;
+    } break;
 
-// * Renders the cursor
-void render_cursor(SDL_Renderer *renderer, const Font* font, Uint32 color) {
-  const Vec2f pos = vec2f(
-      (float)editor.cursor_col * FONT_CHAR_WIDTH * FONT_SCALE,
-      (float)editor.cursor_row * FONT_CHAR_HEIGHT * FONT_SCALE);
+    case SDL_RENDER_TARGETS_RESET: {
+      input->target_resets += 1;
+      input->publish = true;
+    } break;
 
-  const SDL_Rect rect = {
-      .x = (int)floorf(pos.x),
-      .y = (int)floorf(pos.y),
-      .w = FONT_CHAR_WIDTH * FONT_SCALE,
-      .h = FONT_CHAR_HEIGHT * FONT_SCALE};
+    case SDL_RENDER_DEVICE_RESET: {
+      input->device_resets += 1;
+      input->publish = true;
+    } break;
 
-  scc(SDL_SetRenderDrawColor(renderer, UNHEX(color)));
-  scc(SDL_RenderFillRect(renderer, &rect));
+    case SDL_MOUSEWHEEL: {
+      // * the wheel scrolls the view without moving the cursor
+      const int step = 3;
+      if (event->wheel.y > 0) {
+        input->viewport.row = input->viewport.row > (size_t) (step * event->wheel.y) ? input->viewport.row - step * event->wheel.y : 0;
+      } else if (event->wheel.y < 0) {
+        input->viewport.row += step * -event->wheel.y;
+        if (input->viewport.row >= editor.size) input->viewport.row = editor.size > 0 ? editor.size - 1 : 0;
+      }
+    } break;
 
-  
-  // * Render the overlapping character on cursor rect
-  const char *c = editor_char_under_cursor(&editor);
-  if (c) {
-    // * set the font texture color to black
-    set_texture_color(font->spritesheet, 0xFF000000);
-    render_char(renderer, font, *c, pos, FONT_SCALE);
+    case SDL_KEYDOWN: {
+      cursor_moved = true;
+      input_clear_status(input);
+      switch (event->key.keysym.sym) {
+        // * Handle Backspace
+        case SDLK_BACKSPACE: {
+          journal_append(&journal, &editor, JOURNAL_BACKSPACE, NULL);
+          editor_backspace(&editor);
+        } break;
+        
+        case SDLK_F2: {
+          if (input->file_path) input->save_requested = true;
+        } break;
+        
+        case SDLK_RETURN: {
+          journal_append(&journal, &editor, JOURNAL_NEWLINE, NULL);
+          editor_insert_new_line(&editor);
+        } break;
+        
+        case SDLK_UP: {
+          if (editor.cursor_row > 0) {
+            editor.cursor_row -= 1;
+          }
+        } break;
+        
+        case SDLK_DOWN: {
+          editor.cursor_row += 1;
+        } break;
+
+        case SDLK_PAGEUP: {
+          editor.cursor_row = editor.cursor_row > input->viewport.rows ? editor.cursor_row - input->viewport.rows : 0;
+        } break;
+
+        case SDLK_PAGEDOWN: {
+          editor.cursor_row += input->viewport.rows;
+        } break;
+        
+        case SDLK_DELETE: {
+          journal_append(&journal, &editor, JOURNAL_DELETE, NULL);
+          editor_delete(&editor);
+        } break;
+
+        case SDLK_z: {
+          if (event->key.keysym.mod & KMOD_CTRL) {
+            if (event->key.keysym.mod & KMOD_SHIFT) {
+              undo_redo(&history, &editor, input_undo_change, input);
+            } else {
+              undo_undo(&history, &editor, input_undo_change, input);
+            }
+          }
+        } break;
+
+        case SDLK_y: {
+          if (event->key.keysym.mod & KMOD_CTRL) {
+            undo_redo(&history, &editor, input_undo_change, input);
+          }
+        } break;
+
+        case SDLK_F3: {
+          input->latency_overlay = !input->latency_overlay;
+          input->publish = true;
+        } break;
+
+        case SDLK_EQUALS:
+        case SDLK_PLUS:
+        case SDLK_KP_PLUS: {
+          if ((event->key.keysym.mod & KMOD_CTRL) && font_scale < FONT_MAX_SCALE) {
+            font_scale += 1;
+          }
+        } break;
+
+        case SDLK_MINUS:
+        case SDLK_KP_MINUS: {
+          if ((event->key.keysym.mod & KMOD_CTRL) && font_scale > FONT_MIN_SCALE) {
+            font_scale -= 1;
+          }
+        } break;
+
+        case SDLK_0: {
+          if (event->key.keysym.mod & KMOD_CTRL) {
+            font_scale = FONT_DEFAULT_SCALE;
+          }
+        } break;
+
+        case SDLK_LEFT: {
+          if (editor.cursor_col > 0)
+            editor.cursor_col -= 1;
+          } break;
+
+        case SDLK_RIGHT: {
+          editor.cursor_col += 1;
+        } break;
+      }
+    } break;
+
+    case SDL_TEXTINPUT: {
+      journal_append(&journal, &editor, JOURNAL_INSERT, event->text.text);
+      editor_insert_text_before_cursor(&editor, event->text.text);
+      cursor_moved = true;
+      input_clear_status(input);
+    } break;
+
+    case RECORD_PASTE_EVENT: {
+      input_paste(event->user.data1);
+      cursor_moved = true;
+      input_clear_status(input);
+    } break;
+  }
+
+  if (cursor_moved) {
+    if (editor.size != size_before) {
+      // * lines were added or removed, everything below moved
+      damage_rows(&input->damage, row_before < editor.cursor_row ? row_before : editor.cursor_row, SIZE_MAX);
+    } else {
+      damage_row(&input->damage, row_before);
+      damage_row(&input->damage, editor.cursor_row);
+    }
+    input->follow_cursor = true;
+  }
+}
+
+/*
+* Starts the save F2 asked for once the last one is over and the file is
+* fully loaded, and follows it in the status. The save runs in the
+* background, the text it writes is fixed when it starts.
+*/
+void input_poll_save(Input *input) {
+  if (input->save_requested && save_poll(&save_job) != SAVE_RUNNING && !loader.done) {
+    // * waiting for the loader here would freeze typing until the whole file is in
+    input_set_status(input, false, "save after load: %s %3d%%", input->file_path,
+                     (int) (loader_progress(&loader) * 100));
+    return;
+  }
+  if (input->save_requested && save_poll(&save_job) != SAVE_RUNNING) {
+    input->save_cut = journal_mark(&journal);
+    save_start(&save_job, &editor, input->file_path);
+    input->save_requested = false;
+    // * even a save that is over by the next poll gets its status
+    input->save_state = SAVE_RUNNING;
+  }
+  const Save_State save_state = save_poll(&save_job);
+  if (save_state == SAVE_RUNNING) {
+    input_set_status(input, false, "saving %s %3d%%", input->file_path,
+                     (int) (save_fraction(&save_job) * 100));
+  } else if (save_state != input->save_state) {
+    if (save_state == SAVE_DONE) {
+      input_set_status(input, false, "saved %s", input->file_path);
+      // * the edits up to the save are in the file now
+      journal_compact(&journal, input->save_cut);
+    } else {
+      input_set_status(input, true, "save failed: %s", save_job.progress.error);
+    }
+  }
+  input->save_state = save_state;
+}
+
+// * Brings the view up to date after a batch of events
+void input_update(Input *input, const Viewport *viewport_before, int font_scale_before) {
+  const size_t size_before = editor.size;
+  const bool loading = !loader.done;
+  if (loader_poll(&loader)) {
+    damage_rows(&input->damage, size_before > 0 ? size_before - 1 : 0, SIZE_MAX);
+  }
+  // * the progress bar moves while loading and goes away at the end
+  if (loading) input->publish = true;
+
+  // * metrics are plain multiples of the font cell, no need to ask the render thread
+  viewport_resize(&input->viewport, input->width, input->height,
+                  FONT_CHAR_WIDTH * font_scale, FONT_CHAR_HEIGHT * font_scale);
+  if (input->follow_cursor) {
+    viewport_follow(&input->viewport, editor.cursor_row, editor.cursor_col);
+    input->follow_cursor = false;
+  }
+  if (memcmp(&input->viewport, viewport_before, sizeof(*viewport_before)) != 0 || font_scale != font_scale_before) {
+    input->publish = true;
+  }
+  if (damage_any(&input->damage)) input->publish = true;
+
+  input_poll_save(input);
+}
+
+// * Freezes what the render thread needs to draw the next frame
+Snapshot *input_snapshot(Input *input, Snapshot_Buffer *snapshots) {
+  TRACE_ZONE("input_snapshot");
+  Snapshot *snapshot = snapshot_take(snapshots, &editor, &input->viewport, &input->damage);
+  snapshot->taken = SDL_GetPerformanceCounter();
+  snapshot->width = input->width;
+  snapshot->height = input->height;
+  snapshot->font_scale = font_scale;
+  snapshot->loading = !loader.done;
+  snapshot->load_progress = loader_progress(&loader);
+  snapshot->redraws = input->redraws;
+  snapshot->target_resets = input->target_resets;
+  snapshot->device_resets = input->device_resets;
+  snapshot->latency_overlay = input->latency_overlay;
+  memcpy(snapshot->status, input->status, sizeof(snapshot->status));
+  snapshot->status_error = input->status_error;
+  input->damage = (Damage) {0};
+  input->publish = false;
+  return snapshot;
+}
+
+// * While replaying, real events are dropped except for closing the window
+void replay_pump(Input *input) {
+  SDL_Event event;
+  while (SDL_PollEvent(&event)) {
+    if (event.type == SDL_QUIT) input->quit = true;
+  }
+}
+
+// * Sleeps until the event recorded `due_us` into the session is due
+void replay_wait(Input *input, Uint64 replay_start, uint64_t due_us, bool windowed) {
+  for (;;) {
+    if (windowed) replay_pump(input);
+    const uint64_t now_us = ticks_to_us(SDL_GetPerformanceCounter() - replay_start);
+    if (input->quit || now_us >= due_us) return;
+    // * the last millisecond is spun away, SDL_Delay is not that precise
+    const uint64_t ms = (due_us - now_us) / 1000;
+    SDL_Delay(ms > 10 ? 10 : (Uint32) ms);
   }
 }
 
 void usage(FILE *stream) {
-  fprintf(stream, "Usage: te [FILE-PATH\n");
+  fprintf(stream, "Usage: te [OPTIONS] [FILE-PATH]\n");
+  fprintf(stream, "Options:\n");
+  fprintf(stream, "  --memory-report    print the editor memory usage after loading the file\n");
+  fprintf(stream, "  --load-timings     print the time to first paint and to a fully loaded file\n");
+  fprintf(stream, "  --line-cache MB    texture memory for rendered lines (default %d, 0 disables)\n", LINE_CACHE_DEFAULT_MB);
+  fprintf(stream, "  --undo-memory MB   memory kept for undo, the oldest edits go first (default %d, 0 disables)\n", UNDO_DEFAULT_MB);
+  fprintf(stream, "  --line-cache-stats print the line cache hit/miss counters on exit\n");
+  fprintf(stream, "  --frame-stats      print frame counts and input/render thread timings on exit\n");
+  fprintf(stream, "  --software         draw text on the CPU into the window surface, no SDL_Renderer\n");
+  fprintf(stream, "  --latency-dump FILE write the keystroke latency histograms to FILE on exit (F3 shows them)\n");
+  fprintf(stream, "  --record FILE      record the input events of the session to FILE\n");
+  fprintf(stream, "  --replay FILE      feed the events recorded in FILE instead, quit at the end and report timings\n");
+  fprintf(stream, "  --headless         with --replay: no window and no render thread, only the editor\n");
+  fprintf(stream, "  --realtime         with --replay: keep the recorded pace instead of going flat out\n");
+  fprintf(stream, "  --chrome-trace FILE write load, edit, render and save zones to FILE (open it in Perfetto)\n");
 }
 
 int main(int argc, char **argv) {
+  const Uint64 start = SDL_GetPerformanceCounter();
 
-  // * Check if filepath was provided
+  // * Check if filepath and options were provided
   const char *open_file_path = NULL;
-  if (argc > 1) {
-    open_file_path = argv[1];
+  bool memory_report = false;
+  bool load_timings = false;
+  size_t line_cache_mb = LINE_CACHE_DEFAULT_MB;
+  size_t undo_mb = UNDO_DEFAULT_MB;
+  bool line_cache_stats = false;
+  bool frame_stats = false;
+  bool software = false;
+  const char *latency_dump_path = NULL;
+  const char *record_path = NULL;
+  const char *replay_path = NULL;
+  bool headless = false;
+  bool realtime = false;
+  const char *chrome_trace_path = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--memory-report") == 0) {
+      memory_report = true;
+    } else if (strcmp(argv[i], "--load-timings") == 0) {
+      load_timings = true;
+    } else if (strcmp(argv[i], "--line-cache") == 0) {
+      if (i + 1 >= argc) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: no value provided for `%s`\n", argv[i]);
+        return 1;
+      }
+      line_cache_mb = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--undo-memory") == 0) {
+      if (i + 1 >= argc) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: no value provided for `%s`\n", argv[i]);
+        return 1;
+      }
+      undo_mb = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--line-cache-stats") == 0) {
+      line_cache_stats = true;
+    } else if (strcmp(argv[i], "--frame-stats") == 0) {
+      frame_stats = true;
+    } else if (strcmp(argv[i], "--software") == 0) {
+      software = true;
+    } else if (strcmp(argv[i], "--latency-dump") == 0) {
+      if (i + 1 >= argc) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: no value provided for `%s`\n", argv[i]);
+        return 1;
+      }
+      latency_dump_path = argv[++i];
+    } else if (strcmp(argv[i], "--record") == 0) {
+      if (i + 1 >= argc) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: no value provided for `%s`\n", argv[i]);
+        return 1;
+      }
+      record_path = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0) {
+      if (i + 1 >= argc) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: no value provided for `%s`\n", argv[i]);
+        return 1;
+      }
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "--chrome-trace") == 0) {
+      if (i + 1 >= argc) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: no value provided for `%s`\n", argv[i]);
+        return 1;
+      }
+      chrome_trace_path = argv[++i];
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      headless = true;
+    } else if (strcmp(argv[i], "--realtime") == 0) {
+      realtime = true;
+    } else if (strcmp(argv[i], "--help") == 0) {
+      usage(stdout);
+      return 0;
+    } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+      usage(stderr);
+      fprintf(stderr, "ERROR: unknown option `%s`\n", argv[i]);
+      return 1;
+    } else {
+      open_file_path = argv[i];
+    }
+  }
+  if ((headless || realtime) && replay_path == NULL) {
+    usage(stderr);
+    fprintf(stderr, "ERROR: `--headless` and `--realtime` only apply to `--replay`\n");
+    return 1;
+  }
+  if (record_path && replay_path) {
+    usage(stderr);
+    fprintf(stderr, "ERROR: `--record` and `--replay` can not be used together\n");
+    return 1;
   }
 
+  Recording replaying = {0};
+  if (replay_path && !record_open(&replaying, replay_path)) return 1;
+
+  // * before the loader and render threads so their zones are in the trace too
+  if (chrome_trace_path && !tracing_start(chrome_trace_path)) return 1;
+  tracing_thread_name("input");
+
   if (open_file_path) {
     FILE *f = fopen(open_file_path, "r");
     if (f != NULL) {
-      editor_load_from_file(&editor, f);
+      // * lines are split on background threads while the window comes up
+      if (!editor_open_file(&editor, f)) {
+        fprintf(stderr, "ERROR: could not load file `%s`\n", open_file_path);
+        return 1;
+      }
+      loader_start(&loader, &editor, loader_default_threads());
       fclose(f);
     }
   }
 
-  scc(SDL_Init(SDL_INIT_VIDEO));
+  // * the recorded events refer to the whole file, not to however much had loaded
+  if (memory_report || replay_path) {
+    loader_finish(&loader);
+  }
+  if (memory_report) {
+    editor_memory_report(&editor, stdout);
+  }
 
-  SDL_Window *window = scp(SDL_CreateWindow("Text Editor",
-                                            0, 0, WIDTH, HEIGHT, SDL_WINDOW_RESIZABLE));
+  SDL_Window *window = NULL;
+  if (!headless) {
+    scc(SDL_Init(SDL_INIT_VIDEO));
+    window = scp(SDL_CreateWindow("Text Editor",
+                                  0, 0, WIDTH, HEIGHT, SDL_WINDOW_RESIZABLE));
+    if (replay_path) SDL_SetWindowSize(window, replaying.width, replaying.height);
 
-  SDL_Renderer *renderer = scp(SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC));
+    if (software && SDL_GetWindowSurface(window)->format->BytesPerPixel != 4) {
+      fprintf(stderr, "WARNING: the window surface is not 32 bits per pixel, using the renderer\n");
+      software = false;
+    }
+  }
 
-  const char *file_path = "./charmap-oldschool_white.png";
-  Font font = font_load_from_file(renderer, file_path);
+  Render_Thread render = {
+    .window = window,
+    .software = software,
+    .line_cache_mb = line_cache_mb,
+    .line_cache_stats = line_cache_stats,
+    .load_timings = load_timings,
+    .start = start,
+  };
+  snapshot_buffer_init(&render.snapshots);
+  atomic_init(&render.quit, false);
+  // * headless, snapshots are still taken and published but nobody draws them
+  pthread_t render_thread_id;
+  if (window && pthread_create(&render_thread_id, NULL, render_thread, &render) != 0) {
+    fprintf(stderr, "ERROR: could not start the render thread\n");
+    return 1;
+  }
 
-  // * Event loop
-  bool quit = false;
-  while(!quit) {
+  // * Event loop: this thread owns the editor and publishes snapshots of it
+  Input input = {
+    .damage = {.all = true},
+    .publish = true,
+    // * a replay must not write over the file
+    .file_path = replay_path ? NULL : open_file_path,
+  };
+  if (replay_path) {
+    // * the view follows the recorded window, whatever size the real one got
+    input.width = replaying.width;
+    input.height = replaying.height;
+  } else {
+    SDL_GetWindowSize(window, &input.width, &input.height);
+  }
+  // * edits a crashed session never saved come back before anything else happens
+  if (input.file_path) {
+    if (journal_open(&journal, input.file_path)) {
+      loader_finish(&loader);
+      const size_t recovered = journal_recover(&journal, &editor);
+      if (recovered > 0) {
+        input_set_status(&input, false, "recovered %zu unsaved edits from %s", recovered, journal.path);
+        input.follow_cursor = true;
+      }
+    }
+    journal_start(&journal);
+  }
+  // * recovered edits can not be undone, the history starts after them
+  if (undo_mb > 0) {
+    undo_init(&history, undo_mb * 1024 * 1024);
+    editor.history = &history;
+  }
+  Recording recording = {0};
+  if (record_path && !record_create(&recording, record_path, input.width, input.height)) return 1;
+
+  bool loaded = loader.done;
+  size_t events_handled = 0;
+  Timing input_times = {0};
+  // * keystrokes applied since the last snapshot, handed to the render thread with it
+  Latency_Sample keystrokes[LATENCY_PENDING_CAPACITY];
+  size_t keystrokes_count = 0;
+  // * replay: one event per batch, from when it is read to its snapshot, in nanoseconds
+  static Latency_Histogram replay_ns = {0};
+  const Uint64 replay_start = SDL_GetPerformanceCounter();
+  while(!input.quit) {
     SDL_Event event = {0};
-    while (SDL_PollEvent(&event)) {
-      switch (event.type) {
-        case SDL_QUIT: {
-          quit = true;
-        } break;
+    bool has_event;
+    if (replay_path) {
+      uint64_t due_us;
+      has_event = record_next(&replaying, &event, &due_us);
+      if (!has_event) {
+        input.quit = true;
+      } else if (realtime) {
+        replay_wait(&input, replay_start, due_us, window != NULL);
+      } else if (window) {
+        replay_pump(&input);
+      }
+    } else {
+      // * sleep until something happens, but keep an eye on the loader and the save while they run
+      has_event = loader.done && save_poll(&save_job) != SAVE_RUNNING
+        ? SDL_WaitEvent(&event)
+        : SDL_WaitEventTimeout(&event, LOADER_POLL_MS);
+    }
+    const Uint64 woke = SDL_GetPerformanceCounter();
+    const bool replayed = replay_path && has_event;
 
-        case SDL_KEYDOWN: {
-          switch (event.key.keysym.sym) {
-            // * Handle Backspace
-            case SDLK_BACKSPACE: {
-              editor_backspace(&editor);
-            } break;
-            
-            case SDLK_F2: {
-              if (open_file_path) {
-                editor_save_to_file(&editor, open_file_path);
-              }
-            } break;
-            
-            case SDLK_RETURN: {
-              editor_insert_new_line(&editor);
-            } break;
-            
-            case SDLK_UP: {
-              if (editor.cursor_row > 0) {
-                editor.cursor_row -= 1;
-              }
-            } break;
-            
-            case SDLK_DOWN: {
-              editor.cursor_row += 1;
-            } break;
-            
-            case SDLK_DELETE: {
-              editor_delete(&editor);
-            } break;
-
-            case SDLK_LEFT: {
-              if (editor.cursor_col > 0)
-                editor.cursor_col -= 1;
-              } break;
-
-            case SDLK_RIGHT: {
-              editor.cursor_col += 1;
-            } break;
-          }
-        } break;
+    const Viewport viewport_before = input.viewport;
+    const int font_scale_before = font_scale;
+    while (has_event) {
+      const Uint64 received = SDL_GetPerformanceCounter();
+      events_handled += 1;
+      if (!replay_path) input_capture_paste(&event);
+      if (record_path) record_event(&recording, &event, ticks_to_us(received));
 
-        case SDL_TEXTINPUT: {
-          editor_insert_text_before_cursor(&editor, event.text.text);
-        } break;
+      handle_event(&input, &event);
+
+      if (window && (event.type == SDL_KEYDOWN || event.type == SDL_TEXTINPUT || event.type == RECORD_PASTE_EVENT)) {
+        if (keystrokes_count < LATENCY_PENDING_CAPACITY) {
+          keystrokes[keystrokes_count++] = (Latency_Sample) {
+            .received = received,
+            .edited = SDL_GetPerformanceCounter(),
+          };
+        } else {
+          render.keystrokes.overflows += 1;
+        }
       }
+
+      if (event.type == RECORD_PASTE_EVENT) free(event.user.data1);
+      has_event = replay_path ? false : SDL_PollEvent(&event);
     }
-    
-    scc(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0));
-    scc(SDL_RenderClear(renderer));
-    
-    // SDL_RenderCopy(renderer, font.spritesheet, &src, &dst);
-    for (size_t row = 0; row < editor.size; ++row) {
-      const Line *line = editor.lines + row;
-      // printf("text: %s\n", line->chars);
-      render_text_sized(renderer, &font,
-                        line->chars,
-                        line->size,
-                        vec2f(0.0f, row * FONT_CHAR_HEIGHT * FONT_SCALE),
-                        0xFFFFFFFF, FONT_SCALE);
+
+    if (!replay_path) SDL_GetWindowSize(window, &input.width, &input.height);
+    input_update(&input, &viewport_before, font_scale_before);
+
+    if (input.publish && !input.quit) {
+      Snapshot *snapshot = input_snapshot(&input, &render.snapshots);
+
+      // * the render thread may pick the snapshot up right away, the samples go first
+      const Uint64 published = SDL_GetPerformanceCounter();
+      for (size_t i = 0; i < keystrokes_count; ++i) {
+        keystrokes[i].seq = snapshot->seq;
+        keystrokes[i].published = published;
+        latency_ring_push(&render.keystrokes, keystrokes[i]);
+      }
+      keystrokes_count = 0;
+      snapshot_publish(&render.snapshots, snapshot);
+      timing_add(&input_times, elapsed_ms(woke));
+    }
+    if (replayed) {
+      latency_record(&replay_ns, (uint64_t) (elapsed_ms(woke) * 1e6));
     }
-    render_cursor(renderer, &font, 0xFFFFFFFF);
 
-    SDL_RenderPresent(renderer);
+    if (load_timings && !loaded && loader.done) {
+      loaded = true;
+      printf("time to full load:   %.2f ms (%zu lines)\n", elapsed_ms(start), editor.size);
+    }
+  }
+  if (record_path) record_close(&recording);
+
+  // * a save still running, or asked for and not started yet, completes before te exits,
+  // * each one compacting the journal once it is done
+  if (input.save_requested) loader_finish(&loader);
+  save_finish(&save_job);
+  input_poll_save(&input);
+  save_finish(&save_job);
+  input_poll_save(&input);
+  // * unsaved edits stay in the journal, te offers them back next time
+  journal_close(&journal);
+
+  if (replay_path) {
+    const double busy_ms = (double) replay_ns.total_us / 1e6;
+    printf("Replayed %zu events from %s: %.2f ms processing, %.2f ms wall, %.0f events/s\n",
+           replaying.events, replay_path, busy_ms, elapsed_ms(replay_start),
+           busy_ms > 0 ? replay_ns.count / (busy_ms / 1000.0) : 0.0);
+    printf("  per event: p50 %.2f us, p99 %.2f us, p99.9 %.2f us, max %.2f us\n",
+           latency_percentile(&replay_ns, 50.0) / 1e3,
+           latency_percentile(&replay_ns, 99.0) / 1e3,
+           latency_percentile(&replay_ns, 99.9) / 1e3,
+           replay_ns.max_us / 1e3);
+    record_close(&replaying);
+  }
+
+  if (window) {
+    atomic_store(&render.quit, true);
+    snapshot_wake(&render.snapshots);
+    pthread_join(render_thread_id, NULL);
+  }
+
+  if (frame_stats) {
+    printf("Frames: %zu rendered, %zu skipped, %zu snapshots dropped\n",
+           render.frames_rendered, render.frames_skipped, render.snapshots_dropped);
+    printf("Threads (%zu events handled):\n", events_handled);
+    timing_report("input: wake to publish", &input_times, stdout);
+    timing_report("render: frame", &render.frame_times, stdout);
+    timing_report("render: snapshot age", &render.snapshot_ages, stdout);
+  }
+  if (latency_dump_path) {
+    FILE *f = fopen(latency_dump_path, "w");
+    if (f == NULL) {
+      fprintf(stderr, "ERROR: could not open file `%s`: %s\n", latency_dump_path, strerror(errno));
+    } else {
+      fprintf(f, "# te keystroke latency in microseconds, %zu samples dropped\n", render.keystrokes.overflows);
+      for (size_t stage = 0; stage < LATENCY_STAGES; ++stage) {
+        latency_dump(&render.latency[stage], latency_stage_names[stage], f);
+      }
+      fclose(f);
+    }
   }
+  snapshot_buffer_free(&render.snapshots);
+  tracing_stop();
 
   SDL_Quit();
   return 0;
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "record.h"
+
+static const char RECORD_MAGIC[8] = {'T', 'E', 'R', 'E', 'C', '\0', 1, 0};
+
+static void record_write_varint(FILE *f, uint64_t value) {
+  while (value >= 0x80) {
+    fputc((int) (value & 0x7F) | 0x80, f);
+    value >>= 7;
+  }
+  fputc((int) value, f);
+}
+
+static bool record_read_varint(FILE *f, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(f);
+    if (c == EOF) return false;
+    *value |= (uint64_t) (c & 0x7F) << shift;
+    if ((c & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+// * Small negative numbers stay small: 0, -1, 1, -2... -> 0, 1, 2, 3...
+static void record_write_signed(FILE *f, int64_t value) {
+  record_write_varint(f, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+static bool record_read_signed(FILE *f, int64_t *value) {
+  uint64_t raw;
+  if (!record_read_varint(f, &raw)) return false;
+  *value = (int64_t) (raw >> 1) ^ -(int64_t) (raw & 1);
+  return true;
+}
+
+bool record_create(Recording *recording, const char *file_path, int width, int height) {
+  memset(recording, 0, sizeof(*recording));
+  recording->file = fopen(file_path, "wb");
+  if (recording->file == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    return false;
+  }
+
+  fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC), recording->file);
+  record_write_varint(recording->file, (uint64_t) width);
+  record_write_varint(recording->file, (uint64_t) height);
+  recording->width = width;
+  recording->height = height;
+  return true;
+}
+
+bool record_open(Recording *recording, const char *file_path) {
+  memset(recording, 0, sizeof(*recording));
+  recording->file = fopen(file_path, "rb");
+  if (recording->file == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    return false;
+  }
+
+  char magic[sizeof(RECORD_MAGIC)];
+  uint64_t width, height;
+  if (fread(magic, 1, sizeof(magic), recording->file) != sizeof(magic)
+      || memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0
+      || !record_read_varint(recording->file, &width)
+      || !record_read_varint(recording->file, &height)) {
+    fprintf(stderr, "ERROR: `%s` is not a te recording\n", file_path);
+    fclose(recording->file);
+    recording->file = NULL;
+    return false;
+  }
+  recording->width = (int) width;
+  recording->height = (int) height;
+  return true;
+}
+
+/*
+* Appends the event if te acts on it. `us` is when it arrived, in
+* microseconds on any clock that does not go backwards.
+*/
+void record_event(Recording *recording, const SDL_Event *event, uint64_t us) {
+  FILE *f = recording->file;
+  Record_Kind kind;
+  switch (event->type) {
+    case SDL_QUIT:                 kind = RECORD_QUIT; break;
+    case SDL_KEYDOWN:              kind = RECORD_KEYDOWN; break;
+    case SDL_TEXTINPUT:            kind = RECORD_TEXTINPUT; break;
+    case SDL_MOUSEWHEEL:           kind = RECORD_MOUSEWHEEL; break;
+    case SDL_WINDOWEVENT:          kind = RECORD_WINDOWEVENT; break;
+    case SDL_RENDER_TARGETS_RESET: kind = RECORD_TARGETS_RESET; break;
+    case SDL_RENDER_DEVICE_RESET:  kind = RECORD_DEVICE_RESET; break;
+    case RECORD_PASTE_EVENT:       kind = RECORD_PASTE; break;
+    default: return;
+  }
+
+  record_write_varint(f, recording->events > 0 && us > recording->last_us ? us - recording->last_us : 0);
+  recording->last_us = us;
+  fputc(kind, f);
+
+  switch (kind) {
+    case RECORD_KEYDOWN: {
+      record_write_varint(f, (uint32_t) event->key.keysym.sym);
+      record_write_varint(f, event->key.keysym.mod);
+    } break;
+
+    case RECORD_TEXTINPUT: {
+      const size_t n = strlen(event->text.text);
+      fputc((int) n, f);
+      fwrite(event->text.text, 1, n, f);
+    } break;
+
+    case RECORD_MOUSEWHEEL: {
+      record_write_signed(f, event->wheel.y);
+    } break;
+
+    case RECORD_WINDOWEVENT: {
+      fputc(event->window.event, f);
+      record_write_signed(f, event->window.data1);
+      record_write_signed(f, event->window.data2);
+    } break;
+
+    case RECORD_PASTE: {
+      const char *text = event->user.data1;
+      const size_t n = strlen(text);
+      record_write_varint(f, n);
+      fwrite(text, 1, n, f);
+    } break;
+
+    case RECORD_QUIT:
+    case RECORD_TARGETS_RESET:
+    case RECORD_DEVICE_RESET:
+      break;
+  }
+  recording->events += 1;
+}
+
+/*
+* Reads the next event and the microseconds since the first one, false
+* at the end of the recording (or where it is cut short)
+*/
+bool record_next(Recording *recording, SDL_Event *event, uint64_t *us) {
+  FILE *f = recording->file;
+  uint64_t delta, value;
+  int64_t signed_value;
+  if (!record_read_varint(f, &delta)) return false;
+  const int kind = fgetc(f);
+  if (kind == EOF) return false;
+
+  memset(event, 0, sizeof(*event));
+  switch ((Record_Kind) kind) {
+    case RECORD_QUIT: {
+      event->type = SDL_QUIT;
+    } break;
+
+    case RECORD_KEYDOWN: {
+      event->type = SDL_KEYDOWN;
+      if (!record_read_varint(f, &value)) return false;
+      event->key.keysym.sym = (SDL_Keycode) value;
+      if (!record_read_varint(f, &value)) return false;
+      event->key.keysym.mod = (Uint16) value;
+    } break;
+
+    case RECORD_TEXTINPUT: {
+      event->type = SDL_TEXTINPUT;
+      const int n = fgetc(f);
+      if (n == EOF || (size_t) n >= sizeof(event->text.text)) return false;
+      if (fread(event->text.text, 1, (size_t) n, f) != (size_t) n) return false;
+      event->text.text[n] = '\0';
+    } break;
+
+    case RECORD_MOUSEWHEEL: {
+      event->type = SDL_MOUSEWHEEL;
+      if (!record_read_signed(f, &signed_value)) return false;
+      event->wheel.y = (Sint32) signed_value;
+    } break;
+
+    case RECORD_WINDOWEVENT: {
+      event->type = SDL_WINDOWEVENT;
+      const int window_event = fgetc(f);
+      if (window_event == EOF) return false;
+      event->window.event = (Uint8) window_event;
+      if (!record_read_signed(f, &signed_value)) return false;
+      event->window.data1 = (Sint32) signed_value;
+      if (!record_read_signed(f, &signed_value)) return false;
+      event->window.data2 = (Sint32) signed_value;
+    } break;
+
+    case RECORD_TARGETS_RESET: {
+      event->type = SDL_RENDER_TARGETS_RESET;
+    } break;
+
+    case RECORD_DEVICE_RESET: {
+      event->type = SDL_RENDER_DEVICE_RESET;
+    } break;
+
+    case RECORD_PASTE: {
+      if (!record_read_varint(f, &value) || value >= SIZE_MAX) return false;
+      char *text = malloc((size_t) value + 1);
+      if (text == NULL) return false;
+      if (fread(text, 1, (size_t) value, f) != (size_t) value) {
+        free(text);
+        return false;
+      }
+      text[value] = '\0';
+      event->type = RECORD_PASTE_EVENT;
+      event->user.data1 = text;
+    } break;
+
+    default: return false;
+  }
+
+  recording->last_us += delta;
+  *us = recording->last_us;
+  recording->events += 1;
+  return true;
+}
+
+void record_close(Recording *recording) {
+  if (recording->file) fclose(recording->file);
+  recording->file = NULL;
+}
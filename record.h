@@ -0,0 +1,53 @@
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+
+/*
+* Recorded editing session: the SDL events te acts on, with the time
+* each one arrived, in a compact binary file.
+*
+*   "TEREC\0\1\0"                 magic and version
+*   varint width, varint height   window size when recording started
+*   records until the end of the file:
+*     varint us                   microseconds since the previous event
+*     u8 kind                     Record_Kind
+*     payload                     see record_event
+*
+* Events te ignores (key releases, mouse motion...) are not recorded.
+* A paste is recorded with its text, so replaying it never depends on
+* what the clipboard holds at the time.
+*/
+typedef enum {
+  RECORD_QUIT = 1,
+  RECORD_KEYDOWN,          /* varint sym, varint mod                 */
+  RECORD_TEXTINPUT,        /* u8 length, bytes                       */
+  RECORD_MOUSEWHEEL,       /* zigzag varint y                        */
+  RECORD_WINDOWEVENT,      /* u8 event, zigzag varint data1, data2   */
+  RECORD_TARGETS_RESET,
+  RECORD_DEVICE_RESET,
+  RECORD_PASTE,            /* varint length, bytes                   */
+} Record_Kind;
+
+// * Ctrl+V with the pasted text in `user.data1`, malloc'd and freed by whoever handles it
+#define RECORD_PASTE_EVENT SDL_USEREVENT
+
+typedef struct {
+  FILE *file;
+  uint64_t last_us;       /* time of the previous event               */
+  int width;              /* window size from the header              */
+  int height;
+  size_t events;          /* recorded or read so far                  */
+} Recording;
+
+bool record_create(Recording *recording, const char *file_path, int width, int height);
+bool record_open(Recording *recording, const char *file_path);
+void record_event(Recording *recording, const SDL_Event *event, uint64_t us);
+bool record_next(Recording *recording, SDL_Event *event, uint64_t *us);
+void record_close(Recording *recording);
+
+#endif // RECORD_H_
@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "render.h"
+#include "tracing.h"
+
+#include "font_rgba.h"
+
+void scc(int code) {
+  if (code < 0) {
+    fprintf(stderr, "SDL ERROR: %s\n", SDL_GetError());
+    exit(1);
+  }
+}
+
+void *scp(void *ptr) {
+  if (ptr == NULL) {
+    fprintf(stderr, "SDL ERROR: %s\n", SDL_GetError());
+    exit(1);
+  }
+  return ptr;
+}
+
+/*
+* Computes the integer metrics of every scale. No texture is created
+* here: each scale gets its atlas the first time it is drawn at.
+*/
+Font font_load(SDL_Renderer *renderer) {
+  static_assert(sizeof(FONT_RGBA) == FONT_WIDTH * FONT_HEIGHT * 4, "font_rgba.h does not match the atlas size");
+
+  Font font = {0};
+  font.renderer = renderer;
+
+  for (int scale = FONT_MIN_SCALE; scale <= FONT_MAX_SCALE; ++scale) {
+    Font_Scale *glyphs = &font.scales[scale];
+    glyphs->scale = scale;
+    glyphs->advance = FONT_CHAR_WIDTH * scale;
+    glyphs->line_height = FONT_CHAR_HEIGHT * scale;
+
+    // * Pre calculate all the glyphs rects
+    for (size_t ascii = ASCII_DISPLAY_LOW; ascii <= ASCII_DISPLAY_HIGH; ++ascii) {
+      const size_t index = ascii - ASCII_DISPLAY_LOW;
+      const int col = index % FONT_COLS;
+      const int row = index / FONT_COLS;
+
+      glyphs->glyph_table[index] = (SDL_Rect){
+          .x = col * glyphs->advance,
+          .y = row * glyphs->line_height,
+          .w = glyphs->advance,
+          .h = glyphs->line_height};
+    }
+  }
+
+  return font;
+}
+
+/*
+* Creates the atlas of one scale: the embedded atlas (already in the
+* texture's RGBA layout, see fontgen.c) blown up pixel by pixel, so every
+* glyph is then copied 1:1 with no filtering.
+*/
+static SDL_Texture *font_create_atlas(SDL_Renderer *renderer, int scale) {
+  const int w = FONT_WIDTH * scale;
+  const int h = FONT_HEIGHT * scale;
+  const Uint32 *src = (const Uint32 *) FONT_RGBA;
+
+  Uint32 *pixels = malloc((size_t) w * h * sizeof(pixels[0]));
+  for (int y = 0; y < h; ++y) {
+    const Uint32 *src_row = &src[(y / scale) * FONT_WIDTH];
+    Uint32 *row = &pixels[(size_t) y * w];
+    for (int x = 0; x < w; ++x) {
+      row[x] = src_row[x / scale];
+    }
+  }
+
+  SDL_Texture *atlas = scp(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                                             SDL_TEXTUREACCESS_STATIC, w, h));
+  scc(SDL_UpdateTexture(atlas, NULL, pixels, w * (int) sizeof(pixels[0])));
+  scc(SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND));
+  free(pixels);
+  return atlas;
+}
+
+/*
+* The font at `scale` (clamped to the supported range), creating its
+* atlas if needed. At most FONT_ATLAS_CACHE atlases are kept; the least
+* recently used one is destroyed to make room, so the returned atlas
+* is only valid until the font is asked for another scale.
+*/
+const Font_Scale *font_at_scale(Font *font, int scale) {
+  if (scale < FONT_MIN_SCALE) scale = FONT_MIN_SCALE;
+  if (scale > FONT_MAX_SCALE) scale = FONT_MAX_SCALE;
+
+  Font_Scale *glyphs = &font->scales[scale];
+  font->clock += 1;
+  glyphs->last_used = font->clock;
+  if (glyphs->atlas != NULL) return glyphs;
+
+  if (font->atlases == FONT_ATLAS_CACHE) {
+    Font_Scale *oldest = NULL;
+    for (int i = FONT_MIN_SCALE; i <= FONT_MAX_SCALE; ++i) {
+      Font_Scale *cached = &font->scales[i];
+      if (cached->atlas && (oldest == NULL || cached->last_used < oldest->last_used)) {
+        oldest = cached;
+      }
+    }
+    SDL_DestroyTexture(oldest->atlas);
+    oldest->atlas = NULL;
+    font->atlases -= 1;
+  }
+
+  glyphs->atlas = font_create_atlas(font->renderer, scale);
+  font->atlases += 1;
+  return glyphs;
+}
+
+// * Destroys every atlas, they are created again when next drawn at
+void font_drop_atlases(Font *font) {
+  for (int scale = FONT_MIN_SCALE; scale <= FONT_MAX_SCALE; ++scale) {
+    if (font->scales[scale].atlas) {
+      SDL_DestroyTexture(font->scales[scale].atlas);
+      font->scales[scale].atlas = NULL;
+    }
+  }
+  font->atlases = 0;
+}
+
+// * Queues one glyph, tinted with `color`, with its top left corner at (x, y)
+void glyph_batch_push(Glyph_Batch *batch,
+                      const Font_Scale *glyphs,
+                      char c,
+                      int x,
+                      int y,
+                      Uint32 color)
+{
+  assert(c >= ASCII_DISPLAY_LOW);
+  assert(c <= ASCII_DISPLAY_HIGH);
+  assert(batch->count == 0 || batch->atlas == glyphs->atlas);
+
+  if (batch->count == batch->capacity) {
+    batch->capacity = batch->capacity == 0 ? 1024 : batch->capacity * 2;
+    batch->vertices = realloc(batch->vertices, 4 * batch->capacity * sizeof(batch->vertices[0]));
+    batch->indices = realloc(batch->indices, 6 * batch->capacity * sizeof(batch->indices[0]));
+  }
+  batch->atlas = glyphs->atlas;
+
+  // * the atlas is drawn 1:1, so both the quad and its texels are whole pixels
+  const SDL_Rect *src = &glyphs->glyph_table[c - ASCII_DISPLAY_LOW];
+  const float atlas_w = (float) (FONT_WIDTH * glyphs->scale);
+  const float atlas_h = (float) (FONT_HEIGHT * glyphs->scale);
+  const float x0 = (float) x;
+  const float y0 = (float) y;
+  const float x1 = (float) (x + src->w);
+  const float y1 = (float) (y + src->h);
+  const float u0 = src->x / atlas_w;
+  const float v0 = src->y / atlas_h;
+  const float u1 = (src->x + src->w) / atlas_w;
+  const float v1 = (src->y + src->h) / atlas_h;
+  const SDL_Color tint = {
+    .r = (color >> (8 * 0)) & 0xFF,
+    .g = (color >> (8 * 1)) & 0xFF,
+    .b = (color >> (8 * 2)) & 0xFF,
+    .a = (color >> (8 * 3)) & 0xFF,
+  };
+
+  SDL_Vertex *v = &batch->vertices[4 * batch->count];
+  v[0] = (SDL_Vertex) {.position = {x0, y0}, .color = tint, .tex_coord = {u0, v0}};
+  v[1] = (SDL_Vertex) {.position = {x1, y0}, .color = tint, .tex_coord = {u1, v0}};
+  v[2] = (SDL_Vertex) {.position = {x0, y1}, .color = tint, .tex_coord = {u0, v1}};
+  v[3] = (SDL_Vertex) {.position = {x1, y1}, .color = tint, .tex_coord = {u1, v1}};
+
+  const int first = (int) (4 * batch->count);
+  int *i = &batch->indices[6 * batch->count];
+  i[0] = first + 0; i[1] = first + 1; i[2] = first + 2;
+  i[3] = first + 2; i[4] = first + 1; i[5] = first + 3;
+
+  batch->count += 1;
+}
+
+// * Draws every queued glyph with a single SDL_RenderGeometry call
+void glyph_batch_flush(Glyph_Batch *batch, SDL_Renderer *renderer) {
+  if (batch->count == 0) return;
+
+  scc(SDL_RenderGeometry(renderer, batch->atlas,
+                         batch->vertices, (int) (4 * batch->count),
+                         batch->indices, (int) (6 * batch->count)));
+  batch->count = 0;
+}
+
+void glyph_batch_free(Glyph_Batch *batch) {
+  free(batch->vertices);
+  free(batch->indices);
+  memset(batch, 0, sizeof(*batch));
+}
+
+void render_text_sized(Glyph_Batch *batch,
+                       const Font_Scale *glyphs,
+                       const char *text,
+                       size_t text_size,
+                       int x,
+                       int y,
+                       Uint32 color)
+{
+  TRACE_ZONE("render_text_sized");
+  for (size_t i = 0; i < text_size; ++i) {
+    glyph_batch_push(batch, glyphs, text[i], x, y, color);
+    x += glyphs->advance;
+  }
+}
+
+// * Renders columns [first_col, first_col + max_cols) of the line, both sides of the gap
+void render_line(Glyph_Batch *batch,
+                 const Font_Scale *glyphs,
+                 const Line *line,
+                 size_t first_col,
+                 size_t max_cols,
+                 int x,
+                 int y,
+                 Uint32 color)
+{
+  String_View before, after;
+  line_columns(line, first_col, max_cols, &before, &after);
+
+  render_text_sized(batch, glyphs, before.data, before.count, x, y, color);
+  x += (int) before.count * glyphs->advance;
+  render_text_sized(batch, glyphs, after.data, after.count, x, y, color);
+}
+
+#define LINE_CACHE_NONE (-1)
+#define LINE_CACHE_INIT_BUCKETS 256
+
+void line_cache_init(Line_Cache *cache, size_t budget) {
+  memset(cache, 0, sizeof(*cache));
+  cache->budget = budget;
+  cache->free_entry = LINE_CACHE_NONE;
+  cache->lru_head = LINE_CACHE_NONE;
+  cache->lru_tail = LINE_CACHE_NONE;
+}
+
+// * FNV-1a over the visible text, mixed with everything else that changes the pixels
+static uint64_t line_cache_hash(String_View before, String_View after, Uint32 color, int scale) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < before.count; ++i) {
+    hash = (hash ^ (unsigned char) before.data[i]) * 0x100000001b3ULL;
+  }
+  for (size_t i = 0; i < after.count; ++i) {
+    hash = (hash ^ (unsigned char) after.data[i]) * 0x100000001b3ULL;
+  }
+
+  hash = (hash ^ color) * 0x100000001b3ULL;
+  hash = (hash ^ (Uint32) scale) * 0x100000001b3ULL;
+  return hash;
+}
+
+static int *line_cache_bucket(Line_Cache *cache, uint64_t hash) {
+  return &cache->buckets[hash & (cache->buckets_count - 1)];
+}
+
+static void line_cache_lru_unlink(Line_Cache *cache, int index) {
+  Line_Cache_Entry *entry = &cache->entries[index];
+  if (entry->lru_prev != LINE_CACHE_NONE) cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+  else cache->lru_head = entry->lru_next;
+  if (entry->lru_next != LINE_CACHE_NONE) cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+  else cache->lru_tail = entry->lru_prev;
+}
+
+static void line_cache_lru_push_front(Line_Cache *cache, int index) {
+  Line_Cache_Entry *entry = &cache->entries[index];
+  entry->lru_prev = LINE_CACHE_NONE;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head != LINE_CACHE_NONE) cache->entries[cache->lru_head].lru_prev = index;
+  cache->lru_head = index;
+  if (cache->lru_tail == LINE_CACHE_NONE) cache->lru_tail = index;
+}
+
+static void line_cache_remove(Line_Cache *cache, int index) {
+  Line_Cache_Entry *entry = &cache->entries[index];
+
+  int *link = line_cache_bucket(cache, entry->hash);
+  while (*link != index) link = &cache->entries[*link].bucket_next;
+  *link = entry->bucket_next;
+  line_cache_lru_unlink(cache, index);
+
+  SDL_DestroyTexture(entry->texture);
+  free(entry->text);
+  cache->used -= entry->bytes;
+  cache->entries_count -= 1;
+
+  entry->texture = NULL;
+  entry->text = NULL;
+  entry->bucket_next = cache->free_entry;
+  cache->free_entry = index;
+}
+
+// * Doubles the bucket array once there are more entries than buckets
+static void line_cache_rehash(Line_Cache *cache) {
+  size_t buckets_count = cache->buckets_count == 0 ? LINE_CACHE_INIT_BUCKETS : cache->buckets_count * 2;
+  free(cache->buckets);
+  cache->buckets = malloc(buckets_count * sizeof(cache->buckets[0]));
+  cache->buckets_count = buckets_count;
+  for (size_t i = 0; i < buckets_count; ++i) {
+    cache->buckets[i] = LINE_CACHE_NONE;
+  }
+
+  for (int index = cache->lru_head; index != LINE_CACHE_NONE; index = cache->entries[index].lru_next) {
+    int *bucket = line_cache_bucket(cache, cache->entries[index].hash);
+    cache->entries[index].bucket_next = *bucket;
+    *bucket = index;
+  }
+}
+
+// * Whether `text` is `before` followed by `after`, either of which may have no data
+static bool line_cache_text_equals(const char *text, String_View before, String_View after) {
+  return (before.count == 0 || memcmp(text, before.data, before.count) == 0) &&
+         (after.count == 0 || memcmp(text + before.count, after.data, after.count) == 0);
+}
+
+static int line_cache_find(Line_Cache *cache, uint64_t hash, String_View before, String_View after,
+                           Uint32 color, int scale) {
+  if (cache->buckets_count == 0) return LINE_CACHE_NONE;
+
+  for (int index = *line_cache_bucket(cache, hash); index != LINE_CACHE_NONE;
+       index = cache->entries[index].bucket_next) {
+    const Line_Cache_Entry *entry = &cache->entries[index];
+    if (entry->hash == hash && entry->count == before.count + after.count &&
+        entry->color == color && entry->scale == scale &&
+        line_cache_text_equals(entry->text, before, after)) {
+      return index;
+    }
+  }
+  return LINE_CACHE_NONE;
+}
+
+static int line_cache_insert(Line_Cache *cache, Line_Cache_Entry entry) {
+  // * evict the least recently used lines until the new one fits
+  while (cache->used + entry.bytes > cache->budget && cache->lru_tail != LINE_CACHE_NONE) {
+    line_cache_remove(cache, cache->lru_tail);
+    cache->evictions += 1;
+  }
+
+  if (cache->entries_count + 1 > cache->buckets_count) {
+    line_cache_rehash(cache);
+  }
+
+  int index = cache->free_entry;
+  if (index != LINE_CACHE_NONE) {
+    cache->free_entry = cache->entries[index].bucket_next;
+  } else {
+    if (cache->entries_size == cache->entries_capacity) {
+      cache->entries_capacity = cache->entries_capacity == 0 ? 64 : cache->entries_capacity * 2;
+      cache->entries = realloc(cache->entries, cache->entries_capacity * sizeof(cache->entries[0]));
+    }
+    index = (int) cache->entries_size++;
+  }
+
+  int *bucket = line_cache_bucket(cache, entry.hash);
+  entry.bucket_next = *bucket;
+  *bucket = index;
+  cache->entries[index] = entry;
+  line_cache_lru_push_front(cache, index);
+
+  cache->used += entry.bytes;
+  cache->entries_count += 1;
+  return index;
+}
+
+// * Rasterizes the text into a new target texture, NULL if the renderer cannot do that
+static SDL_Texture *line_cache_rasterize(Line_Cache *cache, SDL_Renderer *renderer, const Font_Scale *glyphs,
+                                         String_View before, String_View after,
+                                         int w, int h, Uint32 color)
+{
+  SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                                           SDL_TEXTUREACCESS_TARGET, w, h);
+  if (texture == NULL) return NULL;
+
+  SDL_Texture *target = SDL_GetRenderTarget(renderer);
+  scc(SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND));
+  scc(SDL_SetRenderTarget(renderer, texture));
+  scc(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0));
+  scc(SDL_RenderClear(renderer));
+
+  render_text_sized(&cache->batch, glyphs, before.data, before.count, 0, 0, color);
+  render_text_sized(&cache->batch, glyphs, after.data, after.count,
+                    (int) before.count * glyphs->advance, 0, color);
+  glyph_batch_flush(&cache->batch, renderer);
+
+  scc(SDL_SetRenderTarget(renderer, target));
+  return texture;
+}
+
+/*
+* Draws the visible part of the line from its cached texture, rasterizing
+* it on a miss. Lines that cannot be cached (no budget, no render target
+* support) are queued into `batch` instead.
+*/
+void line_cache_render(Line_Cache *cache,
+                       SDL_Renderer *renderer,
+                       Glyph_Batch *batch,
+                       const Font_Scale *glyphs,
+                       const Line *line,
+                       size_t first_col,
+                       size_t max_cols,
+                       int x,
+                       int y,
+                       Uint32 color)
+{
+  String_View before, after;
+  line_columns(line, first_col, max_cols, &before, &after);
+  size_t count = before.count + after.count;
+  if (count == 0) return;
+
+  const int w = (int) count * glyphs->advance;
+  const int h = glyphs->line_height;
+  const size_t bytes = (size_t) w * h * 4;
+
+  uint64_t hash = line_cache_hash(before, after, color, glyphs->scale);
+  int index = line_cache_find(cache, hash, before, after, color, glyphs->scale);
+  if (index != LINE_CACHE_NONE) {
+    cache->hits += 1;
+    line_cache_lru_unlink(cache, index);
+    line_cache_lru_push_front(cache, index);
+  } else {
+    cache->misses += 1;
+    SDL_Texture *texture = NULL;
+    char *text = NULL;
+    if (bytes <= cache->budget && (text = malloc(count)) != NULL) {
+      texture = line_cache_rasterize(cache, renderer, glyphs, before, after, w, h, color);
+    }
+    if (texture == NULL) {
+      free(text);
+      render_line(batch, glyphs, line, first_col, max_cols, x, y, color);
+      return;
+    }
+    if (before.count > 0) memcpy(text, before.data, before.count);
+    if (after.count > 0) memcpy(text + before.count, after.data, after.count);
+
+    index = line_cache_insert(cache, (Line_Cache_Entry) {
+      .hash = hash,
+      .count = count,
+      .text = text,
+      .color = color,
+      .scale = glyphs->scale,
+      .texture = texture,
+      .bytes = bytes,
+    });
+  }
+
+  const SDL_Rect dst = {.x = x, .y = y, .w = w, .h = h};
+  scc(SDL_RenderCopy(renderer, cache->entries[index].texture, NULL, &dst));
+}
+
+// * Drops every cached texture, e.g. after the renderer lost them
+void line_cache_clear(Line_Cache *cache) {
+  while (cache->lru_tail != LINE_CACHE_NONE) {
+    line_cache_remove(cache, cache->lru_tail);
+  }
+}
+
+void line_cache_free(Line_Cache *cache) {
+  line_cache_clear(cache);
+  free(cache->entries);
+  free(cache->buckets);
+  glyph_batch_free(&cache->batch);
+  memset(cache, 0, sizeof(*cache));
+}
+
+void line_cache_report(const Line_Cache *cache, FILE *stream) {
+  size_t lookups = cache->hits + cache->misses;
+  fprintf(stream, "Line cache:\n");
+  fprintf(stream, "  budget:    %zu bytes\n", cache->budget);
+  fprintf(stream, "  used:      %zu bytes (%zu lines)\n", cache->used, cache->entries_count);
+  fprintf(stream, "  hits:      %zu (%.1f%%)\n", cache->hits, lookups ? 100.0 * cache->hits / lookups : 0.0);
+  fprintf(stream, "  misses:    %zu\n", cache->misses);
+  fprintf(stream, "  evictions: %zu\n", cache->evictions);
+}
@@ -0,0 +1,123 @@
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "editor.h"
+
+#define FONT_WIDTH 128
+#define FONT_HEIGHT 64
+#define FONT_COLS 18
+#define FONT_ROWS 7
+#define FONT_CHAR_WIDTH  (FONT_WIDTH / FONT_COLS)
+#define FONT_CHAR_HEIGHT (FONT_HEIGHT / FONT_ROWS)
+
+#define ASCII_DISPLAY_LOW 32
+#define ASCII_DISPLAY_HIGH 126
+
+void scc(int code);
+void *scp(void *ptr);
+
+#define FONT_MIN_SCALE 1
+#define FONT_MAX_SCALE 16
+#define FONT_ATLAS_CACHE 4   /* scaled atlases kept at the same time */
+
+/*
+* The font at one integer scale. It has its own pre-scaled atlas, so glyphs
+* are copied 1:1, and integer metrics, so no float math happens per glyph.
+*/
+typedef struct {
+  int scale;
+  int advance;            /* pixels from one glyph to the next         */
+  int line_height;        /* pixels from one row to the next           */
+  SDL_Texture *atlas;     /* NULL until first drawn at this scale      */
+  unsigned last_used;     /* Font.clock when last asked for            */
+  SDL_Rect glyph_table[ASCII_DISPLAY_HIGH - ASCII_DISPLAY_LOW + 1];
+} Font_Scale;
+
+typedef struct {
+  SDL_Renderer *renderer;
+  Font_Scale scales[FONT_MAX_SCALE + 1];  /* indexed by scale */
+  size_t atlases;         /* atlases currently created                 */
+  unsigned clock;
+} Font;
+
+Font font_load(SDL_Renderer *renderer);
+const Font_Scale *font_at_scale(Font *font, int scale);
+void font_drop_atlases(Font *font);
+
+/*
+* Glyphs queued for drawing: two triangles per glyph, textured with the
+* atlas of one font scale and tinted by the vertex color. A whole frame of text,
+* whatever its colors, goes to the GPU in one SDL_RenderGeometry call on
+* flush. The arrays are kept between frames and only ever grow.
+*/
+typedef struct {
+  SDL_Texture *atlas;     /* of the queued glyphs    */
+  SDL_Vertex *vertices;   /* 4 per glyph             */
+  int *indices;           /* 6 per glyph             */
+  size_t count;           /* glyphs queued           */
+  size_t capacity;        /* glyphs the arrays hold  */
+} Glyph_Batch;
+
+void glyph_batch_push(Glyph_Batch *batch, const Font_Scale *glyphs, char c, int x, int y, Uint32 color);
+void glyph_batch_flush(Glyph_Batch *batch, SDL_Renderer *renderer);
+void glyph_batch_free(Glyph_Batch *batch);
+
+void render_text_sized(Glyph_Batch *batch, const Font_Scale *glyphs, const char *text, size_t text_size,
+                       int x, int y, Uint32 color);
+void render_line(Glyph_Batch *batch, const Font_Scale *glyphs, const Line *line,
+                 size_t first_col, size_t max_cols, int x, int y, Uint32 color);
+
+typedef struct {
+  uint64_t hash;          /* of the visible text, color and scale  */
+  size_t count;           /* glyphs in the texture                 */
+  char *text;             /* the `count` bytes drawn, for hits     */
+  Uint32 color;
+  int scale;
+  SDL_Texture *texture;
+  size_t bytes;           /* texture memory, counted in the budget */
+  int bucket_next;        /* next entry in the hash bucket         */
+  int lru_prev;           /* more recently used entry              */
+  int lru_next;           /* less recently used entry              */
+} Line_Cache_Entry;
+
+/*
+* LRU cache of rasterized lines. Each visible line is looked up by a hash
+* of its visible text, color and scale, then checked against the text
+* itself so a hash collision is a miss; a hit is one SDL_RenderCopy. An
+* edited line hashes to a new key, so only that line is rasterized again
+* while its stale texture ages out. Textures are evicted least recently
+* used first once their memory would exceed `budget` bytes.
+*/
+typedef struct {
+  size_t budget;              /* max bytes of texture memory    */
+  size_t used;                /* bytes of texture memory in use */
+  Line_Cache_Entry *entries;
+  size_t entries_count;       /* live entries                   */
+  size_t entries_size;        /* slots used, live or free       */
+  size_t entries_capacity;
+  int free_entry;             /* free slots, via bucket_next    */
+  int *buckets;
+  size_t buckets_count;       /* power of two                   */
+  int lru_head;               /* most recently used entry       */
+  int lru_tail;               /* least recently used entry      */
+  Glyph_Batch batch;          /* for rasterizing misses         */
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+} Line_Cache;
+
+void line_cache_init(Line_Cache *cache, size_t budget);
+void line_cache_render(Line_Cache *cache, SDL_Renderer *renderer, Glyph_Batch *batch, const Font_Scale *glyphs,
+                       const Line *line, size_t first_col, size_t max_cols,
+                       int x, int y, Uint32 color);
+void line_cache_clear(Line_Cache *cache);
+void line_cache_free(Line_Cache *cache);
+void line_cache_report(const Line_Cache *cache, FILE *stream);
+
+#endif // RENDER_H_
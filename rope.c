@@ -0,0 +1,521 @@
+#include<assert.h>
+#include<string.h>
+#include<stdlib.h>
+
+#include "rope.h"
+
+static Rope_Node *rope_node_new(bool leaf) {
+  Rope_Node *node = calloc(1, sizeof(*node));
+  atomic_init(&node->refs, 1);
+  node->leaf = leaf;
+  return node;
+}
+
+/*
+* Drops a reference to `node`. The last one frees it along with the chars
+* of its lines or its own references to its children.
+*/
+static void rope_node_release(Rope_Node *node) {
+  if (atomic_fetch_sub_explicit(&node->refs, 1, memory_order_acq_rel) != 1) return;
+
+  if (node->leaf) {
+    for (size_t i = 0; i < node->count; ++i) {
+      if (node->as.lines[i].capacity > 0) {
+        free(node->as.lines[i].chars);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < node->count; ++i) {
+      rope_node_release(node->as.inner.children[i]);
+    }
+  }
+  free(node);
+}
+
+/*
+* Makes the node in `*slot` safe to change: a node that is also in a
+* snapshot is replaced by a private copy, which takes a reference to
+* each child, or copies the chars of each owned line of a leaf.
+* Descending with this node by node copies exactly the shared path.
+*/
+static Rope_Node *rope_node_own(Rope_Node **slot) {
+  Rope_Node *node = *slot;
+  if (atomic_load_explicit(&node->refs, memory_order_acquire) == 1) return node;
+
+  Rope_Node *copy = malloc(sizeof(*copy));
+  memcpy(copy, node, sizeof(*copy));
+  atomic_init(&copy->refs, 1);
+  if (copy->leaf) {
+    for (size_t i = 0; i < copy->count; ++i) {
+      Line *line = &copy->as.lines[i];
+      if (line->capacity > 0) {
+        line->chars = malloc(line->capacity);
+        memcpy(line->chars, node->as.lines[i].chars, line->capacity);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < copy->count; ++i) {
+      atomic_fetch_add_explicit(&copy->as.inner.children[i]->refs, 1, memory_order_relaxed);
+    }
+  }
+
+  rope_node_release(node);
+  *slot = copy;
+  return copy;
+}
+
+/*
+* Another reference to the whole rope as it is now. Changes made to the
+* rope afterwards do not show in it; give it back with rope_free.
+*/
+Rope_Node *rope_share(Rope_Node *root) {
+  if (root != NULL) atomic_fetch_add_explicit(&root->refs, 1, memory_order_relaxed);
+  return root;
+}
+
+/*
+* Recomputes the cached line and byte counts from the node's own items
+*/
+static void rope_node_recount(Rope_Node *node) {
+  node->lines = 0;
+  node->bytes = 0;
+  if (node->leaf) {
+    node->lines = node->count;
+    for (size_t i = 0; i < node->count; ++i) {
+      node->bytes += node->as.lines[i].size;
+    }
+  } else {
+    for (size_t i = 0; i < node->count; ++i) {
+      node->lines += node->as.inner.lines[i];
+      node->bytes += node->as.inner.bytes[i];
+    }
+  }
+}
+
+/*
+* Copies the totals of child `i` into its parent's arrays
+*/
+static void rope_inner_sync(Rope_Node *node, size_t i) {
+  node->as.inner.lines[i] = node->as.inner.children[i]->lines;
+  node->as.inner.bytes[i] = node->as.inner.children[i]->bytes;
+}
+
+/*
+* Picks the child that holds `*row` and makes `*row` relative to it.
+* Rows on a boundary between children go to the left one when
+* `inserting`, so that appending always lands in the last child.
+*/
+static size_t rope_node_child_at(const Rope_Node *node, size_t *row, bool inserting) {
+  const size_t *lines = node->as.inner.lines;
+
+  if (inserting && *row == node->lines) {
+    // * appending, the common case while loading a file
+    size_t last = node->count - 1;
+    *row -= node->lines - lines[last];
+    return last;
+  }
+
+  size_t i = 0;
+  while (i + 1 < node->count) {
+    if (inserting ? *row <= lines[i] : *row < lines[i]) break;
+    *row -= lines[i];
+    i += 1;
+  }
+  return i;
+}
+
+const Line *rope_line(const Rope_Node *root, size_t row) {
+  assert(root != NULL && row < root->lines);
+
+  const Rope_Node *node = root;
+  while (!node->leaf) {
+    node = node->as.inner.children[rope_node_child_at(node, &row, false)];
+  }
+  return &node->as.lines[row];
+}
+
+/*
+* The line at `row`, to be changed in place. Follow up with
+* rope_line_resized if its size changes.
+*/
+Line *rope_line_mut(Rope_Node **root, size_t row) {
+  assert(*root != NULL && row < (*root)->lines);
+
+  Rope_Node *node = rope_node_own(root);
+  while (!node->leaf) {
+    node = rope_node_own(&node->as.inner.children[rope_node_child_at(node, &row, false)]);
+  }
+  return &node->as.lines[row];
+}
+
+/*
+* Moves items [from, count) of `node` to the end of `to`
+*/
+static void rope_node_move_tail(Rope_Node *node, size_t from, Rope_Node *to) {
+  size_t n = node->count - from;
+  if (node->leaf) {
+    memcpy(to->as.lines + to->count, node->as.lines + from, n * sizeof(Line));
+  } else {
+    Rope_Inner *src = &node->as.inner;
+    Rope_Inner *dst = &to->as.inner;
+    memcpy(dst->children + to->count, src->children + from, n * sizeof(src->children[0]));
+    memcpy(dst->lines + to->count, src->lines + from, n * sizeof(src->lines[0]));
+    memcpy(dst->bytes + to->count, src->bytes + from, n * sizeof(src->bytes[0]));
+  }
+  to->count += n;
+  node->count = from;
+}
+
+/*
+* Opens a hole at `index` by shifting items [index, count) right by one
+*/
+static void rope_node_open(Rope_Node *node, size_t index) {
+  size_t n = node->count - index;
+  if (node->leaf) {
+    memmove(node->as.lines + index + 1, node->as.lines + index, n * sizeof(Line));
+  } else {
+    Rope_Inner *inner = &node->as.inner;
+    memmove(inner->children + index + 1, inner->children + index, n * sizeof(inner->children[0]));
+    memmove(inner->lines + index + 1, inner->lines + index, n * sizeof(inner->lines[0]));
+    memmove(inner->bytes + index + 1, inner->bytes + index, n * sizeof(inner->bytes[0]));
+  }
+  node->count += 1;
+}
+
+/*
+* Closes the item at `index` by shifting items (index, count) left by one
+*/
+static void rope_node_close(Rope_Node *node, size_t index) {
+  size_t n = node->count - index - 1;
+  if (node->leaf) {
+    memmove(node->as.lines + index, node->as.lines + index + 1, n * sizeof(Line));
+  } else {
+    Rope_Inner *inner = &node->as.inner;
+    memmove(inner->children + index, inner->children + index + 1, n * sizeof(inner->children[0]));
+    memmove(inner->lines + index, inner->lines + index + 1, n * sizeof(inner->lines[0]));
+    memmove(inner->bytes + index, inner->bytes + index + 1, n * sizeof(inner->bytes[0]));
+  }
+  node->count -= 1;
+}
+
+/*
+* Puts `line` or `child` at `index`, splitting the node when it is full.
+* Appending to a full node keeps it full and starts a new right node, so a
+* document built by appending lines ends up with packed leaves.
+* Returns the new right sibling or NULL.
+*/
+static Rope_Node *rope_node_put(Rope_Node *node, size_t index, const Line *line, Rope_Node *child) {
+  size_t capacity = node->leaf ? ROPE_LEAF_LINES : ROPE_BRANCH;
+  Rope_Node *right = NULL;
+  Rope_Node *target = node;
+
+  if (node->count == capacity) {
+    size_t mid = index == capacity ? capacity : capacity / 2;
+    right = rope_node_new(node->leaf);
+    rope_node_move_tail(node, mid, right);
+    if (index > mid || mid == capacity) {
+      target = right;
+      index -= mid;
+    }
+  }
+
+  rope_node_open(target, index);
+  if (target->leaf) {
+    target->as.lines[index] = *line;
+  } else {
+    target->as.inner.children[index] = child;
+    rope_inner_sync(target, index);
+  }
+
+  if (right != NULL) {
+    rope_node_recount(node);
+    rope_node_recount(right);
+  }
+  return right;
+}
+
+static Rope_Node *rope_node_insert(Rope_Node *node, size_t row, const Line *line) {
+  Rope_Node *right = NULL;
+  if (node->leaf) {
+    right = rope_node_put(node, row, line, NULL);
+  } else {
+    size_t i = rope_node_child_at(node, &row, true);
+    Rope_Node *split = rope_node_insert(rope_node_own(&node->as.inner.children[i]), row, line);
+    rope_inner_sync(node, i);
+    if (split != NULL) {
+      right = rope_node_put(node, i + 1, NULL, split);
+    }
+  }
+
+  if (right == NULL) {
+    node->lines += 1;
+    node->bytes += line->size;
+  }
+  return right;
+}
+
+/*
+* The root was split into itself and `right`, grow the tree by one level
+*/
+static void rope_grow_root(Rope_Node **root, Rope_Node *right) {
+  Rope_Node *new_root = rope_node_new(false);
+  new_root->count = 2;
+  new_root->as.inner.children[0] = *root;
+  new_root->as.inner.children[1] = right;
+  rope_inner_sync(new_root, 0);
+  rope_inner_sync(new_root, 1);
+  rope_node_recount(new_root);
+  *root = new_root;
+}
+
+/*
+* Inserts `line` so that it becomes row `row` (0 <= row <= line count)
+*/
+void rope_insert(Rope_Node **root, size_t row, Line line) {
+  if (*root == NULL) {
+    *root = rope_node_new(true);
+  }
+  assert(row <= (*root)->lines);
+
+  Rope_Node *right = rope_node_insert(rope_node_own(root), row, &line);
+  if (right != NULL) {
+    rope_grow_root(root, right);
+  }
+}
+
+/*
+* Makes a leaf holding a copy of `count` (<= ROPE_LEAF_LINES) lines.
+* Leaves are built independently of any tree, e.g. by loader threads,
+* and attached afterwards with rope_append_leaf.
+*/
+Rope_Node *rope_leaf_from_lines(const Line *lines, size_t count) {
+  assert(count <= ROPE_LEAF_LINES);
+
+  Rope_Node *leaf = rope_node_new(true);
+  memcpy(leaf->as.lines, lines, count * sizeof(Line));
+  leaf->count = count;
+  rope_node_recount(leaf);
+  return leaf;
+}
+
+static Rope_Node *rope_node_append_leaf(Rope_Node *node, Rope_Node *leaf) {
+  Rope_Node *right = NULL;
+  size_t last = node->count - 1;
+  if (node->as.inner.children[last]->leaf) {
+    right = rope_node_put(node, node->count, NULL, leaf);
+  } else {
+    Rope_Node *split = rope_node_append_leaf(rope_node_own(&node->as.inner.children[last]), leaf);
+    rope_inner_sync(node, last);
+    if (split != NULL) {
+      right = rope_node_put(node, node->count, NULL, split);
+    }
+  }
+
+  if (right == NULL) {
+    node->lines += leaf->lines;
+    node->bytes += leaf->bytes;
+  }
+  return right;
+}
+
+/*
+* Attaches a whole leaf after the last line, O(log n)
+*/
+void rope_append_leaf(Rope_Node **root, Rope_Node *leaf) {
+  assert(leaf->leaf);
+  if (leaf->count == 0) {
+    free(leaf);
+    return;
+  }
+
+  if (*root == NULL || ((*root)->leaf && (*root)->count == 0)) {
+    rope_free(*root);
+    *root = leaf;
+    return;
+  }
+
+  // * a single leaf root gets the new leaf as its sibling
+  Rope_Node *right = leaf;
+  if (!(*root)->leaf) {
+    right = rope_node_append_leaf(rope_node_own(root), leaf);
+  }
+
+  if (right != NULL) {
+    rope_grow_root(root, right);
+  }
+}
+
+/*
+* Merges child `i + 1` into child `i` when both fit into one node
+*/
+static void rope_node_try_merge(Rope_Node *node, size_t i) {
+  if (i + 1 >= node->count) return;
+
+  size_t capacity = node->as.inner.children[i]->leaf ? ROPE_LEAF_LINES : ROPE_BRANCH;
+  if (node->as.inner.children[i]->count + node->as.inner.children[i + 1]->count > capacity) return;
+
+  Rope_Node *left = rope_node_own(&node->as.inner.children[i]);
+  Rope_Node *right = rope_node_own(&node->as.inner.children[i + 1]);
+
+  rope_node_move_tail(right, 0, left);
+  left->lines += right->lines;
+  left->bytes += right->bytes;
+  free(right);
+
+  rope_node_close(node, i + 1);
+  rope_inner_sync(node, i);
+}
+
+static Line rope_node_remove(Rope_Node *node, size_t row) {
+  Line line;
+  if (node->leaf) {
+    line = node->as.lines[row];
+    rope_node_close(node, row);
+  } else {
+    size_t i = rope_node_child_at(node, &row, false);
+    Rope_Node *child = rope_node_own(&node->as.inner.children[i]);
+    line = rope_node_remove(child, row);
+    rope_inner_sync(node, i);
+
+    if (child->count == 0) {
+      free(child);
+      rope_node_close(node, i);
+    } else {
+      rope_node_try_merge(node, i > 0 ? i - 1 : i);
+    }
+  }
+
+  node->lines -= 1;
+  node->bytes -= line.size;
+  return line;
+}
+
+/*
+* Removes row `row` and gives the Line (and ownership of its chars) back
+*/
+Line rope_remove(Rope_Node **root, size_t row) {
+  assert(*root != NULL && row < (*root)->lines);
+
+  Line line = rope_node_remove(rope_node_own(root), row);
+  // * drop levels that are left with a single child
+  while (!(*root)->leaf && (*root)->count == 1) {
+    Rope_Node *child = (*root)->as.inner.children[0];
+    free(*root);
+    *root = child;
+  }
+  return line;
+}
+
+/*
+* Fixes the cached byte counts after the line at `row` changed size
+*/
+void rope_line_resized(Rope_Node *root, size_t row, size_t old_size, size_t new_size) {
+  Rope_Node *node = root;
+  for (;;) {
+    assert(atomic_load(&node->refs) == 1 && "the line must come from rope_line_mut");
+    node->bytes = node->bytes - old_size + new_size;
+    if (node->leaf) break;
+
+    size_t i = rope_node_child_at(node, &row, false);
+    node->as.inner.bytes[i] = node->as.inner.bytes[i] - old_size + new_size;
+    node = node->as.inner.children[i];
+  }
+}
+
+/*
+* Byte offset where `row` starts, counting one newline after every line
+*/
+size_t rope_offset_of_row(const Rope_Node *root, size_t row) {
+  if (root == NULL) return 0;
+  assert(row <= root->lines);
+
+  size_t offset = 0;
+  const Rope_Node *node = root;
+  while (!node->leaf) {
+    const Rope_Inner *inner = &node->as.inner;
+    size_t i = 0;
+    while (i + 1 < node->count && row >= inner->lines[i]) {
+      offset += inner->bytes[i] + inner->lines[i];
+      row -= inner->lines[i];
+      i += 1;
+    }
+    node = inner->children[i];
+  }
+
+  for (size_t i = 0; i < row && i < node->count; ++i) {
+    offset += node->as.lines[i].size + 1;
+  }
+  return offset;
+}
+
+/*
+* Row that contains byte `offset`; `*row_offset` gets the offset where that
+* row starts. Offsets past the end resolve to the last row.
+*/
+size_t rope_row_at_offset(const Rope_Node *root, size_t offset, size_t *row_offset) {
+  size_t row = 0;
+  size_t start = 0;
+
+  if (root != NULL && root->lines > 0) {
+    const Rope_Node *node = root;
+    while (!node->leaf) {
+      const Rope_Inner *inner = &node->as.inner;
+      size_t i = 0;
+      while (i + 1 < node->count) {
+        size_t span = inner->bytes[i] + inner->lines[i];
+        if (offset - start < span) break;
+        start += span;
+        row += inner->lines[i];
+        i += 1;
+      }
+      node = inner->children[i];
+    }
+
+    size_t i = 0;
+    while (i + 1 < node->count && offset - start >= node->as.lines[i].size + 1) {
+      start += node->as.lines[i].size + 1;
+      i += 1;
+    }
+    row += i;
+  }
+
+  if (row_offset) {
+    *row_offset = start;
+  }
+  return row;
+}
+
+static void rope_node_stats(const Rope_Node *node, Rope_Stats *stats) {
+  stats->nodes += 1;
+  stats->node_bytes += sizeof(*node);
+
+  if (node->leaf) {
+    for (size_t i = 0; i < node->count; ++i) {
+      if (node->as.lines[i].capacity > 0) {
+        stats->owned_lines += 1;
+        stats->owned_bytes += node->as.lines[i].capacity;
+      }
+    }
+  } else {
+    for (size_t i = 0; i < node->count; ++i) {
+      rope_node_stats(node->as.inner.children[i], stats);
+    }
+  }
+}
+
+Rope_Stats rope_stats(const Rope_Node *root) {
+  Rope_Stats stats = {0};
+  if (root != NULL) {
+    rope_node_stats(root, &stats);
+  }
+  return stats;
+}
+
+/*
+* Frees the rope, or only gives back this reference to nodes that are
+* still shared with a snapshot (or a snapshot's with the rope)
+*/
+void rope_free(Rope_Node *root) {
+  if (root == NULL) return;
+  rope_node_release(root);
+}
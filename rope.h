@@ -0,0 +1,65 @@
+#ifndef ROPE_H_
+#define ROPE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "editor.h"
+
+#define ROPE_BRANCH 32      /* max children of an inner node */
+#define ROPE_LEAF_LINES 64  /* max lines stored in a leaf    */
+
+/*
+* Rope of lines: a B-tree whose leaves hold `Line`s and whose nodes cache
+* the number of lines and text bytes below them. Every leaf sits at the
+* same depth, so looking up a row, converting between byte offsets and
+* rows, and inserting or removing a line are all O(log n).
+*
+* Byte counts do not include the newlines between lines. Inner nodes keep
+* a copy of every child's counts next to the child pointers, so picking a
+* child scans one small array instead of touching every sibling.
+*
+* Nodes are reference counted so that rope_share can hand out a snapshot
+* in O(1), e.g. to save the text on another thread. Every change copies
+* the shared nodes on its path first (and the chars of the lines in a
+* shared leaf), so the snapshot never sees the edits made after it.
+*/
+typedef struct {
+  Rope_Node *children[ROPE_BRANCH];
+  size_t lines[ROPE_BRANCH];    /* lines of each child */
+  size_t bytes[ROPE_BRANCH];    /* bytes of each child */
+} Rope_Inner;
+
+struct Rope_Node {
+  atomic_size_t refs; /* the tree it is in plus every snapshot  */
+  bool leaf;          /* stores lines instead of children      */
+  size_t count;       /* children / lines stored in this node  */
+  size_t lines;       /* number of lines in the whole subtree  */
+  size_t bytes;       /* number of text bytes in the subtree   */
+  union {
+    Rope_Inner inner;
+    Line lines[ROPE_LEAF_LINES];
+  } as;
+};
+
+typedef struct {
+  size_t nodes;         /* allocated nodes                       */
+  size_t node_bytes;    /* memory held by the nodes themselves   */
+  size_t owned_lines;   /* lines that own their chars            */
+  size_t owned_bytes;   /* capacity of those lines' gap buffers  */
+} Rope_Stats;
+
+const Line *rope_line(const Rope_Node *root, size_t row);
+Line *rope_line_mut(Rope_Node **root, size_t row);
+Rope_Node *rope_share(Rope_Node *root);
+void rope_insert(Rope_Node **root, size_t row, Line line);
+Line rope_remove(Rope_Node **root, size_t row);
+Rope_Node *rope_leaf_from_lines(const Line *lines, size_t count);
+void rope_append_leaf(Rope_Node **root, Rope_Node *leaf);
+void rope_line_resized(Rope_Node *root, size_t row, size_t old_size, size_t new_size);
+size_t rope_offset_of_row(const Rope_Node *root, size_t row);
+size_t rope_row_at_offset(const Rope_Node *root, size_t offset, size_t *row_offset);
+Rope_Stats rope_stats(const Rope_Node *root);
+void rope_free(Rope_Node *root);
+
+#endif // ROPE_H_
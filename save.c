@@ -0,0 +1,385 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include "save.h"
+#include "rope.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// * shorter runs of the original are cheaper to write along with their neighbours
+#define SAVE_SHARE_MIN (64 * 1024)
+
+typedef struct {
+  int fd;
+  const char *original;       /* the editor's original buffer         */
+  size_t original_size;
+  int share_fd;               /* the original file, -1 to write everything */
+  size_t block_size;          /* of the new file, the unit blocks are shared in */
+  size_t written;             /* bytes in the new file so far         */
+  Save_Progress *progress;    /* NULL when nobody watches             */
+  size_t lines_left;          /* lines still to write                 */
+  struct iovec iov[IOV_MAX];
+  int iov_count;
+} Save_Writer;
+
+static const char save_newline = '\n';
+
+static void save_progress(Save_Writer *writer, size_t size) {
+  writer->written += size;
+  if (writer->progress != NULL) {
+    atomic_fetch_add_explicit(&writer->progress->written, size, memory_order_relaxed);
+  }
+}
+
+static bool save_writev(Save_Writer *writer, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t n = writev(writer->fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    save_progress(writer, n);
+    // * a short write: skip what went out and go again from there
+    while (count > 0 && (size_t) n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov += 1;
+      count -= 1;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+#ifdef __linux__
+/*
+* Shares the blocks of a run of the original with the new file instead of
+* writing them, on file systems that can (btrfs, XFS). A block can only be
+* shared at the same place in a block on both sides, so only runs that
+* line up, which is all of them until the first edit that changes the
+* length of the text, share their whole blocks. The head before the first
+* whole block is written here, the tail is left in `iov` for the caller,
+* and so is all of it when the file system cannot share.
+*/
+static bool save_share(Save_Writer *writer, struct iovec *iov) {
+  const size_t block = writer->block_size;
+  const size_t offset = (const char *) iov->iov_base - writer->original;
+  if (offset % block != writer->written % block) return true;
+
+  const size_t head = (block - offset % block) % block;
+  // * a block can be bigger than the run (1 MiB on NFS), then there is nothing to share
+  if (head >= iov->iov_len) return true;
+  size_t length = (iov->iov_len - head) / block * block;
+  // * the partial block at the end of the file is shared as well
+  if (offset + iov->iov_len == writer->original_size) length = iov->iov_len - head;
+  if (length == 0) return true;
+
+  struct iovec head_iov = {.iov_base = iov->iov_base, .iov_len = head};
+  if (!save_writev(writer, &head_iov, 1)) return false;
+  iov->iov_base = (char *) iov->iov_base + head;
+  iov->iov_len -= head;
+
+  struct file_clone_range range = {
+    .src_fd = writer->share_fd,
+    .src_offset = offset + head,
+    .src_length = length,
+    .dest_offset = writer->written,
+  };
+  if (ioctl(writer->fd, FICLONERANGE, &range) < 0) {
+    if (errno != EOPNOTSUPP && errno != ENOTTY && errno != EXDEV && errno != EINVAL) return false;
+    // * not on this file system, the rest of the save writes everything
+    writer->share_fd = -1;
+    return true;
+  }
+  // * sharing leaves the file offset where it was
+  if (lseek(writer->fd, length, SEEK_CUR) < 0) return false;
+  save_progress(writer, length);
+  iov->iov_base = (char *) iov->iov_base + length;
+  iov->iov_len -= length;
+  return true;
+}
+#else
+static bool save_share(Save_Writer *writer, struct iovec *iov) {
+  (void) iov;
+  writer->share_fd = -1;
+  return true;
+}
+#endif
+
+// * Long enough runs of unedited text may share their blocks with the original file
+static bool save_sharable(const Save_Writer *writer, const struct iovec *iov) {
+  const char *data = iov->iov_base;
+  return writer->share_fd >= 0 && iov->iov_len >= SAVE_SHARE_MIN
+    && data >= writer->original && data + iov->iov_len <= writer->original + writer->original_size;
+}
+
+static bool save_flush(Save_Writer *writer) {
+  int begin = 0;
+  for (int i = 0; i < writer->iov_count; ++i) {
+    struct iovec *iov = &writer->iov[i];
+    if (!save_sharable(writer, iov)) continue;
+    if (!save_writev(writer, &writer->iov[begin], i - begin)) return false;
+    if (!save_share(writer, iov)) return false;
+    // * what was not shared goes out with the next buffers
+    begin = i;
+  }
+  if (!save_writev(writer, &writer->iov[begin], writer->iov_count - begin)) return false;
+  writer->iov_count = 0;
+  return true;
+}
+
+// * Queues `size` bytes at `data`, growing the last buffer instead when they follow it in memory
+static bool save_push(Save_Writer *writer, const char *data, size_t size) {
+  if (size == 0) return true;
+  if (writer->iov_count > 0) {
+    struct iovec *last = &writer->iov[writer->iov_count - 1];
+    if ((const char *) last->iov_base + last->iov_len == data) {
+      last->iov_len += size;
+      return true;
+    }
+  }
+  if (writer->iov_count == IOV_MAX && !save_flush(writer)) return false;
+  writer->iov[writer->iov_count++] = (struct iovec) {.iov_base = (void *) data, .iov_len = size};
+  return true;
+}
+
+static bool save_line(Save_Writer *writer, const Line *line) {
+  String_View before = line_before_gap(line);
+  String_View after = line_after_gap(line);
+  if (!save_push(writer, before.data, before.count)) return false;
+  if (!save_push(writer, after.data, after.count)) return false;
+
+  // * newlines go between lines: loading a file that ends with one makes an empty last line
+  writer->lines_left -= 1;
+  if (writer->lines_left == 0) return true;
+
+  // * a line borrowed from the original is followed by its own newline there, take that one
+  if (writer->iov_count > 0) {
+    const struct iovec *last = &writer->iov[writer->iov_count - 1];
+    const char *end = (const char *) last->iov_base + last->iov_len;
+    if (end >= writer->original && end < writer->original + writer->original_size && *end == '\n') {
+      return save_push(writer, end, 1);
+    }
+  }
+  return save_push(writer, &save_newline, 1);
+}
+
+static bool save_node(Save_Writer *writer, const Rope_Node *node) {
+  if (node->leaf) {
+    for (size_t i = 0; i < node->count; ++i) {
+      if (!save_line(writer, &node->as.lines[i])) return false;
+    }
+  } else {
+    for (size_t i = 0; i < node->count; ++i) {
+      if (!save_node(writer, node->as.inner.children[i])) return false;
+    }
+  }
+  return true;
+}
+
+// * Prints the error and keeps it for whoever follows the save
+static void save_error(Save_Progress *progress, const char *format, ...) {
+  char message[sizeof(progress->error)];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+
+  fprintf(stderr, "ERROR: %s\n", message);
+  if (progress != NULL) memcpy(progress->error, message, sizeof(message));
+}
+
+// * Makes the rename itself durable, the file contents are synced already
+static void save_sync_directory(const char *path, size_t dir_len) {
+  char *dir = dir_len > 0 ? strndup(path, dir_len) : strdup(".");
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (fd < 0 || fsync(fd) < 0) {
+    fprintf(stderr, "WARNING: could not sync directory `%s`: %s\n", dir, strerror(errno));
+  }
+  if (fd >= 0) close(fd);
+  free(dir);
+}
+
+/*
+* The process umask, from /proc/self/status where the kernel has it.
+* Reading it with umask() means setting it for a moment, and a file any
+* other thread creates meanwhile gets no umask at all: call this before
+* the save thread is started.
+*/
+mode_t save_umask(void) {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f != NULL) {
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "Umask:", 6) == 0) {
+        fclose(f);
+        return (mode_t) strtol(line + 6, NULL, 8) & 0777;
+      }
+    }
+    fclose(f);
+  }
+
+  mode_t mask = umask(0);
+  umask(mask);
+  return mask;
+}
+
+// * Permissions for the new file: those of the file it replaces, or the usual ones
+static mode_t save_file_mode(const char *path, mode_t mask) {
+  struct stat st;
+  if (stat(path, &st) == 0) return st.st_mode & 07777;
+  return 0666 & ~mask;
+}
+
+// * Writes the whole text into `fd` and syncs it, returns what failed or NULL
+static const char *save_write_all(const Editor *editor, int fd, mode_t mode, Save_Progress *progress) {
+  // * mkstemp makes the file 0600
+  if (fchmod(fd, mode) < 0) return "set the permissions of";
+  struct stat st;
+  if (fstat(fd, &st) < 0) return "stat";
+
+  Save_Writer *writer = malloc(sizeof(*writer));
+  if (writer == NULL) return "allocate memory for";
+  writer->fd = fd;
+  writer->original = editor->original;
+  writer->original_size = editor->original_size;
+  writer->share_fd = editor->original_mapped ? editor->original_fd : -1;
+  writer->block_size = st.st_blksize > 0 ? (size_t) st.st_blksize : 4096;
+  writer->written = 0;
+  writer->progress = progress;
+  writer->lines_left = editor->lines != NULL ? editor->lines->lines : 0;
+  writer->iov_count = 0;
+  const bool written = (editor->lines == NULL || save_node(writer, editor->lines)) && save_flush(writer);
+  free(writer);
+  if (!written) return "write";
+
+  if (fsync(fd) < 0) return "sync";
+  return NULL;
+}
+
+/*
+* Writes the editor's lines to `file_path` through a temporary file and
+* a rename. Returns false and leaves `file_path` untouched on any error.
+* The new file keeps the permissions of the old one, and a symlink keeps
+* pointing at it, a new file gets 0666 less `mask` (see save_umask).
+* `progress`, when not NULL, follows the bytes written and gets the error.
+*/
+bool save_file_atomic(const Editor *editor, const char *file_path, mode_t mask, Save_Progress *progress) {
+  char *target = realpath(file_path, NULL);
+  const char *path = target != NULL ? target : file_path;
+  const char *slash = strrchr(path, '/');
+  const size_t dir_len = slash != NULL ? (size_t) (slash - path) + 1 : 0;
+
+  // * `dir/.name.te-XXXXXX`: same directory, so the rename never crosses file systems
+  const size_t temp_size = strlen(path) + sizeof("..te-XXXXXX");
+  char *temp_path = malloc(temp_size);
+  snprintf(temp_path, temp_size, "%.*s.%s.te-XXXXXX", (int) dir_len, path, path + dir_len);
+
+  bool ok = false;
+  int fd = mkstemp(temp_path);
+  if (fd < 0) {
+    save_error(progress, "could not create a temporary file next to `%s`: %s", path, strerror(errno));
+  } else {
+    const char *failed = save_write_all(editor, fd, save_file_mode(path, mask), progress);
+    int error = errno;
+    if (close(fd) < 0 && failed == NULL) {
+      failed = "write";
+      error = errno;
+    }
+
+    if (failed != NULL) {
+      save_error(progress, "could not %s `%s`: %s", failed, temp_path, strerror(error));
+    } else if (rename(temp_path, path) < 0) {
+      save_error(progress, "could not replace `%s`: %s", path, strerror(errno));
+    } else {
+      save_sync_directory(path, dir_len);
+      ok = true;
+    }
+    if (!ok) unlink(temp_path);
+  }
+
+  free(temp_path);
+  free(target);
+  return ok;
+}
+
+static void *save_thread(void *arg) {
+  Save_Job *job = arg;
+  const bool ok = save_file_atomic(&job->snapshot, job->file_path, job->mask, &job->progress);
+  // * the nodes the editor did not copy meanwhile are freed right here
+  rope_free(job->snapshot.lines);
+  job->snapshot.lines = NULL;
+  atomic_store_explicit(&job->state, ok ? SAVE_DONE : SAVE_FAILED, memory_order_release);
+  return NULL;
+}
+
+/*
+* Starts saving the editor as it is now to `file_path` in the background.
+* Returns false when a save is running already or the thread could not
+* be started (the job has then failed).
+*/
+bool save_start(Save_Job *job, const Editor *editor, const char *file_path) {
+  if (save_poll(job) == SAVE_RUNNING) return false;
+
+  job->snapshot = *editor;
+  job->snapshot.lines = rope_share(editor->lines);
+  job->file_path = strdup(file_path);
+  job->mask = save_umask();
+  job->total = editor->lines != NULL && editor->lines->lines > 0 ? editor->lines->bytes + editor->lines->lines - 1 : 0;
+  atomic_init(&job->progress.written, 0);
+  job->progress.error[0] = '\0';
+  atomic_init(&job->state, SAVE_RUNNING);
+
+  if (pthread_create(&job->thread, NULL, save_thread, job) != 0) {
+    save_error(&job->progress, "could not start the save thread");
+    rope_free(job->snapshot.lines);
+    job->snapshot.lines = NULL;
+    atomic_store(&job->state, SAVE_FAILED);
+    return false;
+  }
+  job->started = true;
+  return true;
+}
+
+static void save_join(Save_Job *job) {
+  pthread_join(job->thread, NULL);
+  job->started = false;
+  free(job->file_path);
+  job->file_path = NULL;
+}
+
+// * Where the save is, joining its thread once it is over
+Save_State save_poll(Save_Job *job) {
+  const Save_State state = atomic_load_explicit(&job->state, memory_order_acquire);
+  if (state != SAVE_RUNNING && job->started) save_join(job);
+  return state;
+}
+
+// * Waits for the running save, if any
+void save_finish(Save_Job *job) {
+  if (job->started) save_join(job);
+}
+
+// * Fraction of the text written so far, from 0 to 1
+float save_fraction(const Save_Job *job) {
+  if (job->total == 0) return 1.0f;
+  const size_t written = atomic_load_explicit(&job->progress.written, memory_order_relaxed);
+  return written >= job->total ? 1.0f : (float) written / job->total;
+}
@@ -0,0 +1,68 @@
+#ifndef SAVE_H_
+#define SAVE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "editor.h"
+
+/*
+* Saving never writes over the file in place. The text goes to a
+* temporary file in the same directory, which is fsynced and renamed
+* over the original, so the path always holds either the old or the
+* new contents, even if te dies mid-save or the disk fills up.
+*
+* Lines go out in writev batches of up to IOV_MAX buffers. Unedited
+* lines still point into the original buffer, so a run of them and
+* their newlines is one contiguous range and one buffer, and a mostly
+* untouched file takes a handful of large writes.
+*
+* When the original is mapped from a file on btrfs or XFS, long runs of
+* it are not even written: the new file shares their blocks with the
+* original file (FICLONERANGE, which the editor keeps open, so a save
+* that replaced it does not matter), and only the edited lines hit the
+* disk. Blocks are shared in place only, so this covers the text up to
+* the first edit that changes its length; the rest is written. Elsewhere
+* everything is written: an in-kernel copy (copy_file_range) of what
+* cannot be shared measured slower than writev from the mapping.
+*/
+typedef struct {
+  atomic_size_t written;    /* bytes written so far                    */
+  char error[256];          /* why the save failed, empty otherwise    */
+} Save_Progress;
+
+mode_t save_umask(void);
+bool save_file_atomic(const Editor *editor, const char *file_path, mode_t mask, Save_Progress *progress);
+
+typedef enum {
+  SAVE_IDLE,
+  SAVE_RUNNING,
+  SAVE_DONE,
+  SAVE_FAILED,
+} Save_State;
+
+/*
+* A save running on its own thread. It writes the editor as it was when
+* the save started: the rope is shared with rope_share and the editor
+* copies whatever it changes meanwhile, so editing goes on during the
+* save. The editor's original buffer must outlive the save.
+*/
+typedef struct {
+  Editor snapshot;          /* the editor when the save started         */
+  char *file_path;
+  mode_t mask;              /* umask, read before the thread started    */
+  size_t total;             /* bytes to write, newlines included        */
+  Save_Progress progress;
+  pthread_t thread;
+  bool started;             /* the thread is yet to be joined           */
+  atomic_int state;         /* Save_State                               */
+} Save_Job;
+
+bool save_start(Save_Job *job, const Editor *editor, const char *file_path);
+Save_State save_poll(Save_Job *job);
+void save_finish(Save_Job *job);
+float save_fraction(const Save_Job *job);
+
+#endif // SAVE_H_
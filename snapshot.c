@@ -0,0 +1,173 @@
+#include <assert.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_FRESH 4   /* the middle slot holds an unread snapshot */
+
+void damage_rows(Damage *damage, size_t begin, size_t end) {
+  if (begin >= end) return;
+  if (damage->begin >= damage->end) {
+    damage->begin = begin;
+    damage->end = end;
+  } else {
+    if (begin < damage->begin) damage->begin = begin;
+    if (end > damage->end) damage->end = end;
+  }
+}
+
+void damage_row(Damage *damage, size_t row) {
+  damage_rows(damage, row, row + 1);
+}
+
+bool damage_has_row(const Damage *damage, size_t row) {
+  return damage->all || (row >= damage->begin && row < damage->end);
+}
+
+bool damage_any(const Damage *damage) {
+  return damage->all || damage->begin < damage->end;
+}
+
+void snapshot_buffer_init(Snapshot_Buffer *buffer) {
+  memset(buffer, 0, sizeof(*buffer));
+  buffer->back = 0;
+  atomic_init(&buffer->middle, 1);
+  buffer->front = 2;
+  pthread_mutex_init(&buffer->lock, NULL);
+  pthread_cond_init(&buffer->wake, NULL);
+}
+
+static void snapshot_row_release(Snapshot_Row *row) {
+  if (row == NULL) return;
+  assert(row->refs > 0);
+  row->refs -= 1;
+  if (row->refs == 0) free(row);
+}
+
+static void snapshot_release(Snapshot *snapshot) {
+  if (snapshot == NULL) return;
+  for (size_t i = 0; i < snapshot->viewport.rows; ++i) {
+    snapshot_row_release(snapshot->rows[i]);
+  }
+  free(snapshot->rows);
+  free(snapshot);
+}
+
+// * Frees every snapshot, the render thread must be gone by now
+void snapshot_buffer_free(Snapshot_Buffer *buffer) {
+  for (size_t i = 0; i < 3; ++i) {
+    snapshot_release(buffer->slots[i]);
+  }
+  pthread_cond_destroy(&buffer->wake);
+  pthread_mutex_destroy(&buffer->lock);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+static Snapshot_Row *snapshot_row_take(Snapshot_Buffer *buffer, const Line *line, const Viewport *viewport) {
+  String_View before, after;
+  line_columns(line, viewport->col, viewport->cols, &before, &after);
+
+  const size_t size = before.count + after.count;
+  Snapshot_Row *row = malloc(sizeof(*row) + size);
+  row->refs = 1;
+  row->id = buffer->next_row_id++;
+  // * an empty line may have no chars at all
+  if (before.count > 0) memcpy(row->text, before.data, before.count);
+  if (after.count > 0) memcpy(row->text + before.count, after.data, after.count);
+  row->line = (Line) {
+    .capacity = 0,
+    .size = size,
+    .gap = size,
+    .chars = row->text,
+  };
+  return row;
+}
+
+/*
+* Freezes the visible rows of the editor. Rows outside `damage` (the rows
+* edited since the last snapshot) are shared with the last published
+* snapshot when it shows the same columns, the rest are copied. The
+* caller fills in the fields that do not come from the editor and
+* publishes it before taking the next one.
+*/
+Snapshot *snapshot_take(Snapshot_Buffer *buffer, const Editor *editor, const Viewport *viewport, const Damage *damage) {
+  Snapshot *snapshot = calloc(1, sizeof(*snapshot));
+  snapshot->seq = ++buffer->next_seq;
+  snapshot->viewport = *viewport;
+  snapshot->lines = editor->size;
+  snapshot->cursor_row = editor->cursor_row;
+  snapshot->cursor_col = editor->cursor_col;
+  const char *c = editor_char_under_cursor(editor);
+  snapshot->cursor_char = c ? *c : 0;
+  snapshot->rows = calloc(viewport->rows, sizeof(snapshot->rows[0]));
+
+  const Snapshot *latest = buffer->latest;
+  const bool same_columns = latest != NULL
+    && latest->viewport.col == viewport->col
+    && latest->viewport.cols == viewport->cols;
+
+  for (size_t i = 0; i < viewport->rows; ++i) {
+    const size_t row = viewport->row + i;
+    if (row >= editor->size) break;
+
+    if (same_columns && !damage_has_row(damage, row)
+        && row >= latest->viewport.row && row < latest->viewport.row + latest->viewport.rows) {
+      Snapshot_Row *shared = latest->rows[row - latest->viewport.row];
+      if (shared != NULL) {
+        shared->refs += 1;
+        snapshot->rows[i] = shared;
+        continue;
+      }
+    }
+    snapshot->rows[i] = snapshot_row_take(buffer, editor_line(editor, row), viewport);
+  }
+
+  return snapshot;
+}
+
+// * Rings the render thread awake (also used to make it notice shutdown)
+void snapshot_wake(Snapshot_Buffer *buffer) {
+  pthread_mutex_lock(&buffer->lock);
+  buffer->ringing = true;
+  pthread_cond_signal(&buffer->wake);
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+/*
+* Makes the snapshot the one the render thread draws next. Whatever the
+* swap hands back (a snapshot the reader is done with or never saw) is
+* freed here, on the writer side.
+*/
+void snapshot_publish(Snapshot_Buffer *buffer, Snapshot *snapshot) {
+  assert(snapshot->seq == buffer->next_seq);
+  buffer->slots[buffer->back] = snapshot;
+  buffer->latest = snapshot;
+
+  const int old = atomic_exchange(&buffer->middle, buffer->back | SNAPSHOT_FRESH);
+  buffer->back = old & ~SNAPSHOT_FRESH;
+  snapshot_release(buffer->slots[buffer->back]);
+  buffer->slots[buffer->back] = NULL;
+
+  snapshot_wake(buffer);
+}
+
+// * Sleeps until something is published or snapshot_wake is called
+void snapshot_wait(Snapshot_Buffer *buffer) {
+  pthread_mutex_lock(&buffer->lock);
+  while (!buffer->ringing) {
+    pthread_cond_wait(&buffer->wake, &buffer->lock);
+  }
+  buffer->ringing = false;
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+/*
+* The most recent published snapshot, NULL before the first one. It stays
+* valid until the next call.
+*/
+const Snapshot *snapshot_acquire(Snapshot_Buffer *buffer) {
+  if (atomic_load(&buffer->middle) & SNAPSHOT_FRESH) {
+    buffer->front = atomic_exchange(&buffer->middle, buffer->front) & ~SNAPSHOT_FRESH;
+  }
+  return buffer->slots[buffer->front];
+}
@@ -0,0 +1,113 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "editor.h"
+
+#define SNAPSHOT_STATUS_SIZE 128
+
+/*
+* The part of the text that fits into the window: `rows` x `cols` cells
+* starting at (`row`, `col`). Only those cells are drawn each frame.
+*/
+typedef struct {
+  size_t row;     /* first visible row    */
+  size_t col;     /* first visible column */
+  size_t rows;    /* rows that fit        */
+  size_t cols;    /* columns that fit     */
+} Viewport;
+
+/*
+* Rows of the text that changed since the last frame. The frame is kept
+* between frames and only these rows are drawn again.
+*/
+typedef struct {
+  bool all;         /* the whole window must be redrawn */
+  size_t begin;     /* first damaged row                */
+  size_t end;       /* one past the last damaged row    */
+} Damage;
+
+void damage_rows(Damage *damage, size_t begin, size_t end);
+void damage_row(Damage *damage, size_t row);
+bool damage_has_row(const Damage *damage, size_t row);
+bool damage_any(const Damage *damage);
+
+/*
+* The visible columns of one row, frozen. Rows that did not change are
+* shared between consecutive snapshots instead of copied; `id` is unique
+* to every row ever taken, so two snapshots show the same text in a row
+* exactly when their ids match there.
+*/
+typedef struct {
+  size_t refs;      /* snapshots holding the row (input thread only)  */
+  uint64_t id;
+  Line line;        /* borrows `text`, so it can be drawn like any Line */
+  char text[];
+} Snapshot_Row;
+
+/*
+* Everything the render thread needs to draw one frame, taken by the
+* input thread and never modified after it is published.
+*/
+typedef struct {
+  uint64_t seq;             /* publish order, assigned when taken       */
+  uint64_t taken;           /* SDL_GetPerformanceCounter() when taken   */
+  Viewport viewport;
+  int width;                /* window size in pixels                    */
+  int height;
+  int font_scale;
+  size_t lines;             /* lines in the editor                      */
+  size_t cursor_row;
+  size_t cursor_col;
+  char cursor_char;         /* under the cursor, 0 past the line end    */
+  bool loading;             /* the file is still being split into lines */
+  float load_progress;
+  unsigned redraws;         /* bumped when the window content is lost   */
+  unsigned target_resets;   /* bumped on SDL_RENDER_TARGETS_RESET       */
+  unsigned device_resets;   /* bumped on SDL_RENDER_DEVICE_RESET        */
+  bool latency_overlay;     /* show the keystroke latency histogram     */
+  char status[SNAPSHOT_STATUS_SIZE]; /* what the last save did, or empty   */
+  bool status_error;        /* the save failed                          */
+  Snapshot_Row **rows;      /* viewport.rows entries, NULL past the end */
+} Snapshot;
+
+/*
+* Hands snapshots from the input thread (the only writer) to the render
+* thread (the only reader) without locks: a triple buffer whose middle
+* slot is swapped atomically. The writer fills `back` and swaps it into
+* the middle; the reader swaps the middle into `front` whenever it holds
+* a fresh snapshot. Neither side ever waits for the other, snapshots the
+* reader was too slow to see are simply replaced. Old snapshots come
+* back to the writer through the swaps and are freed there, so row
+* reference counts need no atomics.
+*
+* The mutex and condition only put an idle render thread to sleep.
+*/
+typedef struct {
+  Snapshot *slots[3];
+  int back;                 /* slot the writer fills next (writer only) */
+  int front;                /* slot the reader draws (reader only)      */
+  atomic_int middle;        /* slot in between, | SNAPSHOT_FRESH        */
+  Snapshot *latest;         /* last published, rows are shared from it  */
+  uint64_t next_seq;
+  uint64_t next_row_id;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool ringing;             /* a wakeup is pending                      */
+} Snapshot_Buffer;
+
+void snapshot_buffer_init(Snapshot_Buffer *buffer);
+void snapshot_buffer_free(Snapshot_Buffer *buffer);
+
+Snapshot *snapshot_take(Snapshot_Buffer *buffer, const Editor *editor, const Viewport *viewport, const Damage *damage);
+void snapshot_publish(Snapshot_Buffer *buffer, Snapshot *snapshot);
+void snapshot_wake(Snapshot_Buffer *buffer);
+
+void snapshot_wait(Snapshot_Buffer *buffer);
+const Snapshot *snapshot_acquire(Snapshot_Buffer *buffer);
+
+#endif // SNAPSHOT_H_
@@ -0,0 +1,193 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "surface.h"
+#include "render.h"
+#include "font.h"
+
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(SURFACE_NO_SIMD)
+#define SURFACE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// * Widest run of pixels colored with one kernel call
+#define SURFACE_SPAN_CAPACITY 4096
+
+/*
+* Blows FONT up to `scale` (clamped to the font's scales), unless the
+* font is already at that scale
+*/
+void surface_font_set_scale(Surface_Font *font, int scale) {
+  if (scale < FONT_MIN_SCALE) scale = FONT_MIN_SCALE;
+  if (scale > FONT_MAX_SCALE) scale = FONT_MAX_SCALE;
+  if (font->mask != NULL && font->scale == scale) return;
+
+  font->scale = scale;
+  font->advance = FONT_CHAR_WIDTH * scale;
+  font->line_height = FONT_CHAR_HEIGHT * scale;
+  font->mask_pitch = FONT_WIDTH * scale;
+
+  const int h = FONT_HEIGHT * scale;
+  font->mask = realloc(font->mask, (size_t) font->mask_pitch * h);
+  for (int y = 0; y < h; ++y) {
+    const unsigned char *src_row = &FONT[(y / scale) * FONT_WIDTH];
+    unsigned char *row = &font->mask[(size_t) y * font->mask_pitch];
+    for (int x = 0; x < font->mask_pitch; ++x) {
+      row[x] = src_row[x / scale] ? 0xFF : 0x00;
+    }
+  }
+}
+
+void surface_font_free(Surface_Font *font) {
+  free(font->mask);
+  memset(font, 0, sizeof(*font));
+}
+
+// * Converts an 0xAABBGGRR color to the surface's pixel format
+Uint32 surface_map_color(const SDL_Surface *surface, Uint32 color) {
+  return SDL_MapRGBA(surface->format,
+                     (color >> (8 * 0)) & 0xFF,
+                     (color >> (8 * 1)) & 0xFF,
+                     (color >> (8 * 2)) & 0xFF,
+                     (color >> (8 * 3)) & 0xFF);
+}
+
+// * dst[i] = pixel wherever mask[i] is set, dst[i] stays as is elsewhere
+static void surface__fill_row_scalar(Uint32 *dst, const unsigned char *mask, size_t n, Uint32 pixel) {
+  for (size_t i = 0; i < n; ++i) {
+    if (mask[i]) dst[i] = pixel;
+  }
+}
+
+#ifdef SURFACE_SIMD_X86
+
+static void surface__fill_row_sse2(Uint32 *dst, const unsigned char *mask, size_t n, Uint32 pixel) {
+  const __m128i color = _mm_set1_epi32((int) pixel);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int bytes;
+    memcpy(&bytes, mask + i, sizeof(bytes));
+    // * most of a row is background, leave it alone
+    if (bytes == 0) continue;
+
+    // * 0xFF/0x00 mask bytes -> 0xFFFFFFFF/0 pixel masks
+    __m128i m = _mm_cvtsi32_si128(bytes);
+    m = _mm_unpacklo_epi8(m, m);
+    m = _mm_unpacklo_epi16(m, m);
+
+    __m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+    d = _mm_or_si128(_mm_and_si128(m, color), _mm_andnot_si128(m, d));
+    _mm_storeu_si128((__m128i *) (dst + i), d);
+  }
+  surface__fill_row_scalar(dst + i, mask + i, n - i, pixel);
+}
+
+__attribute__((target("avx2")))
+static void surface__fill_row_avx2(Uint32 *dst, const unsigned char *mask, size_t n, Uint32 pixel) {
+  const __m256i color = _mm256_set1_epi32((int) pixel);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    long long bytes;
+    memcpy(&bytes, mask + i, sizeof(bytes));
+    if (bytes == 0) continue;
+
+    // * sign extension turns 0xFF into 0xFFFFFFFF
+    __m256i m = _mm256_cvtepi8_epi32(_mm_cvtsi64_si128(bytes));
+    __m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+    d = _mm256_blendv_epi8(d, color, m);
+    _mm256_storeu_si256((__m256i *) (dst + i), d);
+  }
+  surface__fill_row_sse2(dst + i, mask + i, n - i, pixel);
+}
+
+#endif // SURFACE_SIMD_X86
+
+static void surface__fill_row(Uint32 *dst, const unsigned char *mask, size_t n, Uint32 pixel) {
+#ifdef SURFACE_SIMD_X86
+  if (__builtin_cpu_supports("avx2")) {
+    surface__fill_row_avx2(dst, mask, n, pixel);
+    return;
+  }
+  surface__fill_row_sse2(dst, mask, n, pixel);
+#else
+  surface__fill_row_scalar(dst, mask, n, pixel);
+#endif
+}
+
+const char *surface_kernel_name(void) {
+#ifdef SURFACE_SIMD_X86
+  return __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+/*
+* Draws the text with its top left corner at (x, y), clipped to the
+* surface. `pixel` is already in the surface's format (surface_map_color).
+* The surface must be 32 bits per pixel and locked if it needs to be.
+*/
+void surface_render_text(SDL_Surface *surface,
+                         const Surface_Font *font,
+                         const char *text,
+                         size_t text_size,
+                         int x,
+                         int y,
+                         Uint32 pixel)
+{
+  assert(surface->format->BytesPerPixel == 4);
+  assert(font->mask != NULL);
+  if (x < 0 || y < 0 || x >= surface->w || y >= surface->h) return;
+
+  const size_t advance = font->advance;
+  const size_t width = surface->w - x;
+  if (text_size > (width + advance - 1) / advance) {
+    text_size = (width + advance - 1) / advance;
+  }
+  int rows = font->line_height;
+  if (rows > surface->h - y) rows = surface->h - y;
+
+  // * glyph rows are gathered into one span so the kernel runs over whole lines
+  unsigned char span[SURFACE_SPAN_CAPACITY];
+  const size_t span_glyphs = SURFACE_SPAN_CAPACITY / advance;
+  for (size_t first = 0; first < text_size; first += span_glyphs) {
+    size_t count = text_size - first;
+    if (count > span_glyphs) count = span_glyphs;
+    size_t span_width = count * advance;
+    if (first * advance + span_width > width) span_width = width - first * advance;
+
+    for (int row = 0; row < rows; ++row) {
+      for (size_t i = 0; i < count; ++i) {
+        const char c = text[first + i];
+        assert(c >= ASCII_DISPLAY_LOW);
+        assert(c <= ASCII_DISPLAY_HIGH);
+        const size_t index = c - ASCII_DISPLAY_LOW;
+        const size_t glyph_x = (index % FONT_COLS) * advance;
+        const size_t glyph_y = (index / FONT_COLS) * font->line_height + row;
+        memcpy(&span[i * advance], &font->mask[glyph_y * font->mask_pitch + glyph_x], advance);
+      }
+
+      Uint32 *dst = (Uint32 *) ((Uint8 *) surface->pixels + (size_t) (y + row) * surface->pitch) + x + first * advance;
+      surface__fill_row(dst, span, span_width, pixel);
+    }
+  }
+}
+
+// * Draws columns [first_col, first_col + max_cols) of the line, both sides of the gap
+void surface_render_line(SDL_Surface *surface,
+                         const Surface_Font *font,
+                         const Line *line,
+                         size_t first_col,
+                         size_t max_cols,
+                         int x,
+                         int y,
+                         Uint32 pixel)
+{
+  String_View before, after;
+  line_columns(line, first_col, max_cols, &before, &after);
+
+  surface_render_text(surface, font, before.data, before.count, x, y, pixel);
+  x += (int) before.count * font->advance;
+  surface_render_text(surface, font, after.data, after.count, x, y, pixel);
+}
@@ -0,0 +1,34 @@
+#ifndef SURFACE_H_
+#define SURFACE_H_
+
+#include <SDL.h>
+
+#include "editor.h"
+
+/*
+* Text drawn by the CPU straight into an SDL_Surface (the window surface),
+* for machines where SDL's renderer would be software anyway. Glyphs come
+* from the 8-bit FONT bitmap in font.h blown up to the current scale. Each
+* pixel row of a run of text is expanded from that coverage mask to 32-bit
+* pixels and colored in one pass, 8 (AVX2) or 4 (SSE2) pixels at a time.
+* Define SURFACE_NO_SIMD to force the scalar loop.
+*/
+typedef struct {
+  int scale;
+  int advance;            /* pixels from one glyph to the next         */
+  int line_height;        /* pixels from one row to the next           */
+  int mask_pitch;         /* bytes per row of `mask`                   */
+  unsigned char *mask;    /* FONT at `scale`, 0x00 or 0xFF per pixel   */
+} Surface_Font;
+
+void surface_font_set_scale(Surface_Font *font, int scale);
+void surface_font_free(Surface_Font *font);
+const char *surface_kernel_name(void);
+
+Uint32 surface_map_color(const SDL_Surface *surface, Uint32 color);
+void surface_render_text(SDL_Surface *surface, const Surface_Font *font, const char *text, size_t text_size,
+                         int x, int y, Uint32 pixel);
+void surface_render_line(SDL_Surface *surface, const Surface_Font *font, const Line *line,
+                         size_t first_col, size_t max_cols, int x, int y, Uint32 pixel);
+
+#endif // SURFACE_H_
@@ -66,6 +66,7 @@ SVDEF String_View sv_chop_left(String_View *sv, size_t n);
 SVDEF String_View sv_chop_right(String_View *sv, size_t n);
 SVDEF String_View sv_chop_left_while(String_View *sv, bool (*predicate)(char x));
 SVDEF bool sv_index_of(String_View sv, char c, size_t *index);
+SVDEF size_t sv_index_all(String_View sv, char c, size_t *indices, size_t capacity);
 SVDEF bool sv_eq(String_View a, String_View b);
 SVDEF bool sv_eq_ignorecase(String_View a, String_View b);
 SVDEF bool sv_starts_with(String_View sv, String_View prefix);
@@ -77,6 +78,166 @@ uint64_t sv_chop_u64(String_View *sv);
 
 #ifdef SV_IMPLEMENTATION
 
+// Byte search used by sv_index_of, sv_chop_by_delim, sv_try_chop_by_delim
+// and sv_index_all. On x86 with GCC or Clang it compares 16 (SSE2), 32
+// (AVX2) or 64 (AVX-512BW) bytes per iteration, picking the widest one
+// the CPU supports at runtime. Everything else gets the scalar loop.
+// Define SV_NO_SIMD to force the scalar loop.
+
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(SV_NO_SIMD)
+#define SV_SIMD_X86
+#include <immintrin.h>
+#endif
+
+static size_t sv__find_byte_scalar(const char *data, size_t count, char c)
+{
+    size_t i = 0;
+    while (i < count && data[i] != c) {
+        i += 1;
+    }
+    return i;
+}
+
+static size_t sv__find_all_scalar(const char *data, size_t count, char c,
+                                  size_t *indices, size_t capacity)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < capacity; ++i) {
+        if (data[i] == c) {
+            indices[n++] = i;
+        }
+    }
+    return n;
+}
+
+#ifdef SV_SIMD_X86
+
+// Appends the positions of the set bits of `mask` (relative to `base`)
+// to `indices`, returning from the calling function once `capacity`
+// indices have been written.
+#define SV__PUSH_MASK(mask, base, indices, n, capacity) \
+    do {                                                \
+        while (mask) {                                  \
+            if (*(n) == (capacity)) return *(n);        \
+            (indices)[(*(n))++] = (base) + __builtin_ctzll(mask); \
+            (mask) &= (mask) - 1;                       \
+        }                                               \
+    } while (0)
+
+static size_t sv__find_byte_sse2(const char *data, size_t count, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (data + i));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + sv__find_byte_scalar(data + i, count - i, c);
+}
+
+static size_t sv__find_all_sse2(const char *data, size_t count, char c,
+                                size_t *indices, size_t capacity)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (data + i));
+        unsigned long long mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        SV__PUSH_MASK(mask, i, indices, &n, capacity);
+    }
+    size_t rest = sv__find_all_scalar(data + i, count - i, c, indices + n, capacity - n);
+    for (size_t k = n; k < n + rest; ++k) {
+        indices[k] += i;
+    }
+    return n + rest;
+}
+
+__attribute__((target("avx2")))
+static size_t sv__find_byte_avx2(const char *data, size_t count, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (data + i));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + sv__find_byte_sse2(data + i, count - i, c);
+}
+
+__attribute__((target("avx2")))
+static size_t sv__find_all_avx2(const char *data, size_t count, char c,
+                                size_t *indices, size_t capacity)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (data + i));
+        unsigned long long mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        SV__PUSH_MASK(mask, i, indices, &n, capacity);
+    }
+    size_t rest = sv__find_all_sse2(data + i, count - i, c, indices + n, capacity - n);
+    for (size_t k = n; k < n + rest; ++k) {
+        indices[k] += i;
+    }
+    return n + rest;
+}
+
+__attribute__((target("avx512bw")))
+static size_t sv__find_byte_avx512(const char *data, size_t count, char c)
+{
+    const __m512i needle = _mm512_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64) {
+        __m512i chunk = _mm512_loadu_si512((const void *) (data + i));
+        unsigned long long mask = _mm512_cmpeq_epi8_mask(chunk, needle);
+        if (mask) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return i + sv__find_byte_avx2(data + i, count - i, c);
+}
+
+__attribute__((target("avx512bw")))
+static size_t sv__find_all_avx512(const char *data, size_t count, char c,
+                                  size_t *indices, size_t capacity)
+{
+    const __m512i needle = _mm512_set1_epi8(c);
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64) {
+        __m512i chunk = _mm512_loadu_si512((const void *) (data + i));
+        unsigned long long mask = _mm512_cmpeq_epi8_mask(chunk, needle);
+        SV__PUSH_MASK(mask, i, indices, &n, capacity);
+    }
+    size_t rest = sv__find_all_avx2(data + i, count - i, c, indices + n, capacity - n);
+    for (size_t k = n; k < n + rest; ++k) {
+        indices[k] += i;
+    }
+    return n + rest;
+}
+
+#endif // SV_SIMD_X86
+
+// Index of the first `c` in `data`, or `count` when there is none
+static size_t sv__find_byte(const char *data, size_t count, char c)
+{
+#ifdef SV_SIMD_X86
+    if (__builtin_cpu_supports("avx512bw")) return sv__find_byte_avx512(data, count, c);
+    if (__builtin_cpu_supports("avx2")) return sv__find_byte_avx2(data, count, c);
+    return sv__find_byte_sse2(data, count, c);
+#else
+    return sv__find_byte_scalar(data, count, c);
+#endif
+}
+
 SVDEF String_View sv_from_parts(const char *data, size_t count)
 {
     String_View sv;
@@ -144,10 +305,7 @@ SVDEF String_View sv_chop_right(String_View *sv, size_t n)
 
 SVDEF bool sv_index_of(String_View sv, char c, size_t *index)
 {
-    size_t i = 0;
-    while (i < sv.count && sv.data[i] != c) {
-        i += 1;
-    }
+    size_t i = sv__find_byte(sv.data, sv.count, c);
 
     if (i < sv.count) {
         if (index) {
@@ -159,12 +317,23 @@ SVDEF bool sv_index_of(String_View sv, char c, size_t *index)
     }
 }
 
+// Writes the indices of up to `capacity` occurrences of `c` in `sv` to
+// `indices` and returns how many were written. To get the rest, call it
+// again on the part of `sv` after the last index.
+SVDEF size_t sv_index_all(String_View sv, char c, size_t *indices, size_t capacity)
+{
+#ifdef SV_SIMD_X86
+    if (__builtin_cpu_supports("avx512bw")) return sv__find_all_avx512(sv.data, sv.count, c, indices, capacity);
+    if (__builtin_cpu_supports("avx2")) return sv__find_all_avx2(sv.data, sv.count, c, indices, capacity);
+    return sv__find_all_sse2(sv.data, sv.count, c, indices, capacity);
+#else
+    return sv__find_all_scalar(sv.data, sv.count, c, indices, capacity);
+#endif
+}
+
 SVDEF bool sv_try_chop_by_delim(String_View *sv, char delim, String_View *chunk)
 {
-    size_t i = 0;
-    while (i < sv->count && sv->data[i] != delim) {
-        i += 1;
-    }
+    size_t i = sv__find_byte(sv->data, sv->count, delim);
 
     String_View result = sv_from_parts(sv->data, i);
 
@@ -182,10 +351,7 @@ SVDEF bool sv_try_chop_by_delim(String_View *sv, char delim, String_View *chunk)
 
 SVDEF String_View sv_chop_by_delim(String_View *sv, char delim)
 {
-    size_t i = 0;
-    while (i < sv->count && sv->data[i] != delim) {
-        i += 1;
-    }
+    size_t i = sv__find_byte(sv->data, sv->count, delim);
 
     String_View result = sv_from_parts(sv->data, i);
 
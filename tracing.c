@@ -0,0 +1,181 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "tracing.h"
+
+typedef struct {
+  const char *name;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+} Trace_Event;
+
+/*
+* One thread's events. Only the thread moves `head` and only the flusher
+* moves `tail`, so neither waits for the other; when the flusher falls
+* behind, new events are dropped and counted.
+*/
+typedef struct Trace_Ring {
+  Trace_Event events[TRACE_RING_CAPACITY];
+  atomic_size_t head;                 /* next event to write          */
+  atomic_size_t tail;                 /* next event to flush          */
+  atomic_size_t dropped;
+  int tid;
+  _Atomic(const char *) thread_name;  /* NULL until the thread names itself */
+  struct Trace_Ring *next;
+} Trace_Ring;
+
+atomic_bool tracing_enabled = false;
+
+// * rings are never freed: a thread may still end a zone after tracing_stop
+static _Thread_local Trace_Ring *trace_ring = NULL;
+static _Atomic(Trace_Ring *) trace_rings = NULL;
+static atomic_int trace_next_tid = 1;
+
+static FILE *trace_file = NULL;
+static bool trace_file_empty = true;
+static uint64_t trace_origin_ns = 0;
+static pthread_t trace_flusher;
+static atomic_bool trace_flusher_quit = false;
+
+uint64_t trace_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static Trace_Ring *trace_thread_ring(void) {
+  if (trace_ring != NULL) return trace_ring;
+
+  Trace_Ring *ring = malloc(sizeof(*ring));
+  if (ring == NULL) return NULL;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->dropped, 0);
+  atomic_init(&ring->thread_name, NULL);
+  ring->tid = atomic_fetch_add(&trace_next_tid, 1);
+
+  // * pushed onto the list the flusher walks, without a lock
+  ring->next = atomic_load(&trace_rings);
+  while (!atomic_compare_exchange_weak(&trace_rings, &ring->next, ring)) {}
+  trace_ring = ring;
+  return ring;
+}
+
+void trace_record(const char *name, uint64_t begin_ns, uint64_t end_ns) {
+  Trace_Ring *ring = trace_thread_ring();
+  if (ring == NULL) return;
+
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head - tail == TRACE_RING_CAPACITY) {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  ring->events[head % TRACE_RING_CAPACITY] = (Trace_Event) {name, begin_ns, end_ns};
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// * Shows the calling thread as `name` in the trace viewer
+void tracing_thread_name(const char *name) {
+  if (!atomic_load_explicit(&tracing_enabled, memory_order_relaxed)) return;
+  Trace_Ring *ring = trace_thread_ring();
+  if (ring != NULL) atomic_store(&ring->thread_name, name);
+}
+
+static void trace_write_separator(void) {
+  fputs(trace_file_empty ? "\n" : ",\n", trace_file);
+  trace_file_empty = false;
+}
+
+// * Writes out every event recorded so far, only ever called by one thread at a time
+static void trace_flush(void) {
+  for (Trace_Ring *ring = atomic_load(&trace_rings); ring != NULL; ring = ring->next) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (; tail < head; ++tail) {
+      const Trace_Event *event = &ring->events[tail % TRACE_RING_CAPACITY];
+      trace_write_separator();
+      // * microseconds with three decimals, printed as integers: floats are too slow to format
+      const uint64_t ts = event->begin_ns - trace_origin_ns;
+      const uint64_t dur = event->end_ns - event->begin_ns;
+      fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+              "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu}",
+              event->name, ring->tid,
+              (unsigned long long) (ts / 1000), (unsigned long long) (ts % 1000),
+              (unsigned long long) (dur / 1000), (unsigned long long) (dur % 1000));
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+  fflush(trace_file);
+}
+
+static void *trace_flusher_main(void *arg) {
+  (void) arg;
+  const struct timespec period = {0, TRACE_FLUSH_MS * 1000000L};
+  while (!atomic_load(&trace_flusher_quit)) {
+    nanosleep(&period, NULL);
+    trace_flush();
+  }
+  return NULL;
+}
+
+/*
+* Starts recording zones into `file_path` as a Chrome trace (JSON array
+* format, so a trace cut short by a crash still opens). Call before
+* starting any thread that should be traced.
+*/
+bool tracing_start(const char *file_path) {
+  trace_file = fopen(file_path, "w");
+  if (trace_file == NULL) {
+    fprintf(stderr, "ERROR: could not open file `%s`: %s\n", file_path, strerror(errno));
+    return false;
+  }
+  fputs("[", trace_file);
+  trace_file_empty = true;
+  trace_origin_ns = trace_now();
+
+  atomic_store(&trace_flusher_quit, false);
+  if (pthread_create(&trace_flusher, NULL, trace_flusher_main, NULL) != 0) {
+    fprintf(stderr, "ERROR: could not start the trace flusher thread\n");
+    fclose(trace_file);
+    trace_file = NULL;
+    return false;
+  }
+  atomic_store(&tracing_enabled, true);
+  return true;
+}
+
+// * Stops recording and completes the trace file with the thread names
+void tracing_stop(void) {
+  if (trace_file == NULL) return;
+
+  atomic_store(&tracing_enabled, false);
+  atomic_store(&trace_flusher_quit, true);
+  pthread_join(trace_flusher, NULL);
+  trace_flush();
+
+  size_t dropped = 0;
+  trace_write_separator();
+  fprintf(trace_file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"te\"}}");
+  for (Trace_Ring *ring = atomic_load(&trace_rings); ring != NULL; ring = ring->next) {
+    const char *name = atomic_load(&ring->thread_name);
+    if (name != NULL) {
+      trace_write_separator();
+      fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              ring->tid, name);
+    }
+    dropped += atomic_load(&ring->dropped);
+  }
+  fputs("\n]\n", trace_file);
+  fclose(trace_file);
+  trace_file = NULL;
+
+  if (dropped > 0) {
+    fprintf(stderr, "WARNING: %zu trace events were dropped, the flusher could not keep up\n", dropped);
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef TRACING_H_
+#define TRACING_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define TRACE_RING_CAPACITY (1 << 16)   /* events per thread between two flushes */
+#define TRACE_FLUSH_MS 10               /* how often the rings are written out    */
+
+/*
+* Scoped trace zones written as Chrome trace events, to be opened in
+* Perfetto (ui.perfetto.dev) or chrome://tracing.
+*
+*   void editor_delete(Editor *editor) {
+*     TRACE_ZONE("editor_delete");
+*     ...
+*   }
+*
+* A zone is timed from its TRACE_ZONE to the end of the enclosing block.
+* Every thread records into its own ring, so zones take no lock; a
+* background thread drains the rings into the file. Until
+* tracing_start() a zone costs a relaxed atomic load and a branch, and
+* building with -DNO_TRACING removes the zones altogether.
+*/
+typedef struct {
+  const char *name;       /* must outlive the trace: a string literal */
+  uint64_t begin_ns;      /* 0 when tracing was off                   */
+} Trace_Zone;
+
+extern atomic_bool tracing_enabled;
+
+bool tracing_start(const char *file_path);
+void tracing_stop(void);
+void tracing_thread_name(const char *name);
+
+uint64_t trace_now(void);
+void trace_record(const char *name, uint64_t begin_ns, uint64_t end_ns);
+
+static inline Trace_Zone trace_zone_begin(const char *name) {
+  Trace_Zone zone = {name, 0};
+  if (atomic_load_explicit(&tracing_enabled, memory_order_relaxed)) zone.begin_ns = trace_now();
+  return zone;
+}
+
+static inline void trace_zone_end(Trace_Zone *zone) {
+  if (zone->begin_ns != 0) trace_record(zone->name, zone->begin_ns, trace_now());
+}
+
+#ifndef NO_TRACING
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name)                                                        \
+  Trace_Zone TRACE_CONCAT(trace_zone_, __LINE__) __attribute__((cleanup(trace_zone_end))) \
+    = trace_zone_begin(name)
+#else
+#define TRACE_ZONE(name) (void) 0
+#endif
+
+#endif // TRACING_H_
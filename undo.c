@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "undo.h"
+#include "tracing.h"
+
+// * A change as it sits in the arena, its text right after the header
+typedef struct {
+  size_t row;
+  size_t col;
+  size_t size;              /* text bytes                                  */
+  size_t back;              /* bytes back to the previous record in the block */
+  Undo_Change_Kind kind;
+} Undo_Record;
+
+struct Undo_Block {
+  Undo_Block *prev;
+  Undo_Block *next;
+  size_t capacity;          /* bytes of `data`                          */
+  size_t used;              /* bytes bumped so far                      */
+  size_t last;              /* offset of the last record                */
+  _Alignas(Undo_Record) char data[];
+};
+
+#define UNDO_RECORD_LENGTH(size)                                                \
+  ((sizeof(Undo_Record) + (size) + _Alignof(Undo_Record) - 1) / _Alignof(Undo_Record) * _Alignof(Undo_Record))
+
+static Undo_Record *undo_record_at(const Undo_Block *block, size_t offset) {
+  return (Undo_Record *) (block->data + offset);
+}
+
+static char *undo_record_text(Undo_Record *record) {
+  return (char *) (record + 1);
+}
+
+void undo_init(Undo_History *history, size_t max_bytes) {
+  memset(history, 0, sizeof(*history));
+  history->max_bytes = max_bytes;
+}
+
+static void undo_free_block(Undo_History *history, Undo_Block *block) {
+  history->bytes -= sizeof(*block) + block->capacity;
+  free(block);
+}
+
+/*
+* Bumps room for a record with `size` bytes of text, in a new block when
+* the last one is full
+*/
+static Undo_Record *undo_push_record(Undo_History *history, size_t size,
+                                     Undo_Block **block, size_t *offset) {
+  const size_t length = UNDO_RECORD_LENGTH(size);
+  Undo_Block *tail = history->tail;
+
+  if (tail == NULL || tail->capacity - tail->used < length) {
+    // * an emptied block would sit between two records and break the walk back
+    if (tail != NULL && tail->used == 0) {
+      history->tail = tail->prev;
+      if (history->tail) history->tail->next = NULL; else history->head = NULL;
+      undo_free_block(history, tail);
+    }
+
+    const size_t capacity = length > UNDO_BLOCK_SIZE ? length : UNDO_BLOCK_SIZE;
+    Undo_Block *fresh = malloc(sizeof(*fresh) + capacity);
+    if (fresh == NULL) {
+      fprintf(stderr, "ERROR: could not allocate %zu bytes of undo history\n", capacity);
+      exit(1);
+    }
+    fresh->prev = history->tail;
+    fresh->next = NULL;
+    fresh->capacity = capacity;
+    fresh->used = 0;
+    fresh->last = 0;
+    if (history->tail) history->tail->next = fresh; else history->head = fresh;
+    history->tail = fresh;
+    history->bytes += sizeof(*fresh) + capacity;
+    tail = fresh;
+  }
+
+  Undo_Record *record = undo_record_at(tail, tail->used);
+  record->back = tail->used - tail->last;
+  tail->last = tail->used;
+  tail->used += length;
+
+  *block = tail;
+  *offset = tail->last;
+  return record;
+}
+
+static Undo_Group *undo_push_group(Undo_History *history) {
+  if (history->start + history->count == history->capacity) {
+    if (history->start >= history->capacity / 2 && history->start > 0) {
+      // * at least half the array was evicted, sliding the rest down pays for itself
+      memmove(history->groups, history->groups + history->start, history->count * sizeof(*history->groups));
+      history->start = 0;
+    } else {
+      const size_t capacity = history->capacity ? 2 * history->capacity : 256;
+      Undo_Group *groups = realloc(history->groups, capacity * sizeof(*groups));
+      if (groups == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu undo groups\n", capacity);
+        exit(1);
+      }
+      history->groups = groups;
+      history->capacity = capacity;
+    }
+  }
+
+  history->count += 1;
+  return &history->groups[history->start + history->count - 1];
+}
+
+/*
+* Forgets the undone groups: a new edit starts a new branch. The arena
+* is popped back to their first record and the blocks after it freed.
+*/
+static void undo_drop_redo(Undo_History *history) {
+  if (history->done == history->count) return;
+
+  const Undo_Group *first = &history->groups[history->start + history->done];
+  Undo_Block *block = first->first_block;
+  while (block->next != NULL) {
+    Undo_Block *next = block->next->next;
+    undo_free_block(history, block->next);
+    block->next = next;
+  }
+  history->tail = block;
+  block->last = first->first - undo_record_at(block, first->first)->back;
+  block->used = first->first;
+
+  history->count = history->done;
+}
+
+/*
+* Drops the oldest groups until the arena fits under the cap again, but
+* never the newest one: that edit can always be undone
+*/
+static void undo_evict(Undo_History *history) {
+  while (history->bytes > history->max_bytes && history->count > 1) {
+    history->start += 1;
+    history->count -= 1;
+    history->done -= 1;
+
+    // * a block goes once no group is left in it
+    Undo_Block *keep = history->groups[history->start].first_block;
+    while (history->head != keep) {
+      Undo_Block *head = history->head;
+      history->head = head->next;
+      history->head->prev = NULL;
+      undo_free_block(history, head);
+    }
+  }
+}
+
+/*
+* Whether a keystroke goes in the open group: the same kind of edit,
+* right where the last one left the cursor, without starting a new word
+*/
+static bool undo_joins(const Undo_History *history, Undo_Edit edit,
+                       const Undo_Change *change, Undo_Cursor before) {
+  if (!history->open || history->count == 0) return false;
+  if (history->depth > 0 || history->edit == UNDO_EDIT_ANY) return true;
+  if (edit != history->edit || edit == UNDO_EDIT_NEWLINE) return false;
+
+  const Undo_Group *group = &history->groups[history->start + history->count - 1];
+  if (before.row != group->after.row || before.col != group->after.col) return false;
+  if (history->word + change->size > UNDO_WORD_MAX) return false;
+
+  // * "hello world" is "hello " and "world", backwards too
+  const char first = change->size > 0 ? change->text[0] : history->last_char;
+  return !(isspace((unsigned char) history->last_char) && !isspace((unsigned char) first));
+}
+
+/*
+* Grows the last record in place when `change` only carries on with its
+* text: typing further right, or Delete taking out the next character
+*/
+static bool undo_extend(Undo_History *history, const Undo_Group *group, const Undo_Change *change) {
+  Undo_Block *tail = history->tail;
+  if (group->last_block != tail || group->last != tail->last) return false;
+
+  Undo_Record *record = undo_record_at(tail, tail->last);
+  if (record->kind != change->kind || record->row != change->row) return false;
+  if (change->kind == UNDO_INSERT_TEXT) {
+    if (change->col != record->col + record->size) return false;
+  } else if (change->kind == UNDO_REMOVE_TEXT) {
+    if (change->col != record->col) return false;
+  } else {
+    return false;
+  }
+
+  const size_t length = UNDO_RECORD_LENGTH(record->size + change->size);
+  if (length > tail->capacity - tail->last) return false;
+
+  memcpy(undo_record_text(record) + record->size, change->text, change->size);
+  record->size += change->size;
+  tail->used = tail->last + length;
+  return true;
+}
+
+/*
+* Keeps `change`, made by `edit` with the cursor at `before`, which left
+* it at `after`, so it can be undone
+*/
+void undo_record(Undo_History *history, Undo_Edit edit, const Undo_Change *change,
+                 Undo_Cursor before, Undo_Cursor after) {
+  undo_drop_redo(history);
+
+  Undo_Group *group;
+  if (undo_joins(history, edit, change, before)) {
+    group = &history->groups[history->start + history->count - 1];
+    if (history->edit == UNDO_EDIT_ANY) history->edit = edit;
+    history->word += change->size;
+    if (undo_extend(history, group, change)) {
+      group->after = after;
+      if (change->size > 0) history->last_char = change->text[change->size - 1];
+      return;
+    }
+  } else {
+    group = undo_push_group(history);
+    group->first_block = NULL;
+    group->before = before;
+    history->open = true;
+    history->edit = edit;
+    history->word = change->size;
+    history->last_char = 0;
+  }
+
+  Undo_Block *block;
+  size_t offset;
+  Undo_Record *record = undo_push_record(history, change->size, &block, &offset);
+  record->row = change->row;
+  record->col = change->col;
+  record->size = change->size;
+  record->kind = change->kind;
+  if (change->size > 0) memcpy(undo_record_text(record), change->text, change->size);
+
+  if (group->first_block == NULL) {
+    group->first_block = block;
+    group->first = offset;
+  }
+  group->last_block = block;
+  group->last = offset;
+  group->after = after;
+  if (change->size > 0) history->last_char = change->text[change->size - 1];
+  history->done = history->count;
+
+  undo_evict(history);
+}
+
+/*
+* Everything recorded until the matching undo_group_end is one group,
+* undone and redone in one go
+*/
+void undo_group_begin(Undo_History *history) {
+  if (history->depth == 0) history->open = false;
+  history->depth += 1;
+}
+
+void undo_group_end(Undo_History *history) {
+  if (history->depth == 0) return;
+  history->depth -= 1;
+  if (history->depth == 0) history->open = false;
+}
+
+static void undo_apply(Editor *editor, const Undo_Change *change) {
+  switch (change->kind) {
+    case UNDO_INSERT_TEXT: editor_insert_text_at(editor, change->row, change->col, change->text, change->size); break;
+    case UNDO_REMOVE_TEXT: editor_remove_text_at(editor, change->row, change->col, change->size); break;
+    case UNDO_INSERT_LINE: editor_insert_line_at(editor, change->row); break;
+    case UNDO_REMOVE_LINE: editor_remove_line_at(editor, change->row); break;
+  }
+}
+
+/*
+* Takes back the last group, its records last to first, and puts the
+* cursor where it was before it. False when there is nothing to undo.
+*/
+bool undo_undo(Undo_History *history, Editor *editor, Undo_Hook *hook, void *data) {
+  if (history->done == 0) return false;
+  TRACE_ZONE("undo_undo");
+
+  static const Undo_Change_Kind inverse[] = {
+    [UNDO_INSERT_TEXT] = UNDO_REMOVE_TEXT,
+    [UNDO_REMOVE_TEXT] = UNDO_INSERT_TEXT,
+    [UNDO_INSERT_LINE] = UNDO_REMOVE_LINE,
+    [UNDO_REMOVE_LINE] = UNDO_INSERT_LINE,
+  };
+
+  const Undo_Group *group = &history->groups[history->start + history->done - 1];
+  const Undo_Block *block = group->last_block;
+  size_t offset = group->last;
+  for (;;) {
+    Undo_Record *record = undo_record_at(block, offset);
+    const Undo_Change change = {
+      .kind = inverse[record->kind],
+      .row = record->row,
+      .col = record->col,
+      .text = undo_record_text(record),
+      .size = record->size,
+    };
+    if (hook) hook(data, &change);
+    undo_apply(editor, &change);
+
+    if (block == group->first_block && offset == group->first) break;
+    if (offset > 0) {
+      offset -= record->back;
+    } else {
+      block = block->prev;
+      offset = block->last;
+    }
+  }
+
+  history->done -= 1;
+  history->open = false;
+  editor->cursor_row = group->before.row;
+  editor->cursor_col = group->before.col;
+  return true;
+}
+
+/*
+* Makes the last undone group again, first record to last, and puts the
+* cursor where it left it. False when there is nothing to redo.
+*/
+bool undo_redo(Undo_History *history, Editor *editor, Undo_Hook *hook, void *data) {
+  if (history->done == history->count) return false;
+  TRACE_ZONE("undo_redo");
+
+  const Undo_Group *group = &history->groups[history->start + history->done];
+  const Undo_Block *block = group->first_block;
+  size_t offset = group->first;
+  for (;;) {
+    Undo_Record *record = undo_record_at(block, offset);
+    const Undo_Change change = {
+      .kind = record->kind,
+      .row = record->row,
+      .col = record->col,
+      .text = undo_record_text(record),
+      .size = record->size,
+    };
+    if (hook) hook(data, &change);
+    undo_apply(editor, &change);
+
+    if (block == group->last_block && offset == group->last) break;
+    offset += UNDO_RECORD_LENGTH(record->size);
+    if (offset >= block->used) {
+      block = block->next;
+      offset = 0;
+    }
+  }
+
+  history->done += 1;
+  history->open = false;
+  editor->cursor_row = group->after.row;
+  editor->cursor_col = group->after.col;
+  return true;
+}
+
+void undo_free(Undo_History *history) {
+  for (Undo_Block *block = history->head; block != NULL;) {
+    Undo_Block *next = block->next;
+    free(block);
+    block = next;
+  }
+  free(history->groups);
+  memset(history, 0, sizeof(*history));
+}
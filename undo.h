@@ -0,0 +1,99 @@
+#ifndef UNDO_H_
+#define UNDO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "editor.h"
+
+#define UNDO_BLOCK_SIZE (64 * 1024)  /* arena block, bigger for a bigger record   */
+#define UNDO_WORD_MAX 32             /* bytes of keystrokes coalesced in one group */
+#define UNDO_DEFAULT_MB 64           /* history memory cap                         */
+
+/*
+* Undo history: a log of the changes the edits made, never copies of
+* the text, so undoing or redoing costs as much as the change did.
+*
+* Every change is a record in a bump arena of UNDO_BLOCK_SIZE blocks:
+* a header and the bytes inserted or removed, one after the other.
+* Records are grouped into the steps undo and redo take. Keystrokes of
+* the same kind in a row (typing, Backspace, Delete) go in one group up
+* to the end of a word, Enter is a group of its own, and
+* undo_group_begin/undo_group_end put a bigger edit (a paste) in one.
+*
+* When the arena outgrows the cap, the oldest groups are dropped and
+* their blocks freed, first to last. A new edit drops every group that
+* was undone, the arena is popped back to where they started.
+*/
+typedef enum {
+  UNDO_INSERT_TEXT,       /* `text` went in at `row`, `col`          */
+  UNDO_REMOVE_TEXT,       /* `text` was taken out at `row`, `col`    */
+  UNDO_INSERT_LINE,       /* an empty line went in at `row`          */
+  UNDO_REMOVE_LINE,       /* the empty line at `row` was taken out   */
+} Undo_Change_Kind;
+
+typedef struct {
+  Undo_Change_Kind kind;
+  size_t row;
+  size_t col;
+  const char *text;
+  size_t size;
+} Undo_Change;
+
+// * Which edit a change came from, only keystrokes of the same kind coalesce
+typedef enum {
+  UNDO_EDIT_ANY,          /* joins whatever comes next (the first line of an empty editor) */
+  UNDO_EDIT_TYPE,
+  UNDO_EDIT_BACKSPACE,
+  UNDO_EDIT_DELETE,
+  UNDO_EDIT_NEWLINE,
+} Undo_Edit;
+
+typedef struct {
+  size_t row;
+  size_t col;
+} Undo_Cursor;
+
+typedef struct Undo_Block Undo_Block;
+
+typedef struct {
+  Undo_Block *first_block;  /* where its first and last records are */
+  size_t first;
+  Undo_Block *last_block;
+  size_t last;
+  Undo_Cursor before;       /* the cursor before and after the group */
+  Undo_Cursor after;
+} Undo_Group;
+
+struct Undo_History {
+  size_t max_bytes;         /* arena cap, the open group is never dropped */
+  size_t bytes;             /* arena blocks allocated                   */
+  Undo_Block *head;         /* oldest block                             */
+  Undo_Block *tail;         /* block records are bumped into            */
+
+  Undo_Group *groups;       /* groups[start .. start + count)           */
+  size_t start;
+  size_t count;
+  size_t capacity;
+  size_t done;              /* groups applied, the rest can be redone   */
+
+  bool open;                /* the last group takes more keystrokes     */
+  Undo_Edit edit;           /* what the open group is made of           */
+  size_t word;              /* its bytes                                */
+  char last_char;           /* the last byte typed or removed in it     */
+  size_t depth;             /* undo_group_begin nesting                 */
+};
+
+// * Called with every change undo or redo is about to make, e.g. to journal it
+typedef void Undo_Hook(void *data, const Undo_Change *change);
+
+void undo_init(Undo_History *history, size_t max_bytes);
+void undo_record(Undo_History *history, Undo_Edit edit, const Undo_Change *change,
+                 Undo_Cursor before, Undo_Cursor after);
+void undo_group_begin(Undo_History *history);
+void undo_group_end(Undo_History *history);
+bool undo_undo(Undo_History *history, Editor *editor, Undo_Hook *hook, void *data);
+bool undo_redo(Undo_History *history, Editor *editor, Undo_Hook *hook, void *data);
+void undo_free(Undo_History *history);
+
+#endif // UNDO_H_